@@ -0,0 +1,445 @@
+/* Microbenchmarks of the kernel's hot paths, driven directly with the
+   hardware and the drivers stubbed out, so that nothing but the kernel
+   runs (its events are only counted):
+
+   enqueue  : a semaphore wait queue (PID_QUEUE) of depth processes; move
+              the head to the tail
+   dispatch : make_ready() of the running process then schedule(), as in a
+              preemption, with every other process READY
+   clock    : handle_clock_interrupt() every CLOCK_INTERRUPT_PERIOD ms,
+              preempting whenever a time slice runs out
+   semaphore: handle_semaphore() DOWN and UP, with contention processes
+              per semaphore; the running process is preempted after every
+              DOWN that does not block it, so it holds the semaphore while
+              the others try to take it
+   disk     : handle_disk_read() by the running process, and
+              handle_disk_interrupt() for the oldest read whenever depth
+              reads are outstanding or nothing can run
+   keyboard : the same with handle_keyboard() and
+              handle_keyboard_interrupt()
+   sleep    : handle_sleep() by the running process, for up to 100 s
+              (less if there are so many sleeps per process that the clock
+              would wrap), and whenever nothing can run, the clock moved on
+              to the kernel's next deadline and handle_clock_interrupt(),
+              which wakes the sleepers due then; nearly every process is
+              asleep at once
+   batch    : handle_trap() of semaphore UPs by the running process, depth
+              to a BATCH trap (one, a trap of its own)
+
+   Each is run with 10, 100, ... processes up to the maximum; dispatch and
+   clock under every scheduling policy, the others under MLFQ. An
+   operation is one queue move, dispatch, clock interrupt, semaphore trap,
+   completed read, sleep or UP, and the results are the time per operation and
+   operations per second.
+
+   Usage: bench_kernel [-n max processes] [-i operations] [-o results file]
+
+   Results go to standard output by default, as CSV, or as JSON if the
+   file name ends in .json, one line or object per run, so that runs of
+   different versions of the kernel can be compared. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "hardware.h"
+#include "drivers.h"
+#include "kernel.h"
+#include "process_table.h"
+#include "semaphore.h"
+#include "scheduler.h"
+
+// The stub hardware: registers, clock and interrupt table, and drivers
+// that do nothing (the benchmarks deliver the interrupts themselves)
+
+PID_type current_pid;
+int R1, R2, R3, R4;
+CLOCK_TIME clock;
+FN_TYPE INTERRUPT_TABLE[KEYBOARD_INTERRUPT + 1];
+
+void disk_read_req(PID_type pid, int size)
+{
+}
+
+void keyboard_read_req(PID_type pid)
+{
+}
+
+void disk_write_req(PID_type pid)
+{
+}
+
+// Kernel entry points that kernel.c declares for itself
+
+void handle_trap();
+void handle_fork();
+void handle_semaphore();
+void handle_disk_read();
+void handle_keyboard();
+void handle_sleep();
+void handle_clock_interrupt();
+void handle_disk_interrupt();
+void handle_keyboard_interrupt();
+void schedule();
+void make_ready(PID_type pid);
+void enqueue(PID_QUEUE *queue, PID_type pid);
+PID_type dequeue(PID_QUEUE *queue);
+
+static const char *policy_names[NUMBER_OF_SCHED_POLICIES] = { "mlfq", "cfs",
+  "stride", "lottery" };
+
+static const int depths[] = { 1, 16, 256 };
+static const int contentions[] = { 1, 8, 64 };
+static const int batch_sizes[] = { 1, 8, MAX_BATCH };
+
+static double now_ns()
+{
+  struct timeval tv;
+
+  // Not clock_gettime(): <time.h> clashes with the hardware's clock
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+// Where results go and how many have been written
+
+static FILE *out;
+static BOOL json;
+static int results;
+
+static void report(const char *benchmark, int policy, int processes,
+  int depth, int contention, long ops, double ns)
+{
+  if (json)
+    fprintf(out, "%s\n  {\"benchmark\": \"%s\", \"policy\": \"%s\", "
+      "\"processes\": %d, \"depth\": %d, \"contention\": %d, "
+      "\"ops\": %ld, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f}",
+      results ? "," : "", benchmark, policy_names[policy], processes, depth,
+      contention, ops, ns / ops, ops * 1e9 / ns);
+  else
+    fprintf(out, "%s,%s,%d,%d,%d,%ld,%.2f,%.0f\n", benchmark,
+      policy_names[policy], processes, depth, contention, ops, ns / ops,
+      ops * 1e9 / ns);
+  fflush(out);
+  results++;
+}
+
+// Boots a quiet kernel in which process 0 runs and has forked the other
+// processes, all READY
+
+static KERNEL_CONTEXT *boot(int processes, int policy, int semaphores)
+{
+  KERNEL_CONTEXT *context = kernel_create();
+  PID_type pid;
+
+  kernel_set_log(context, KERNEL_LOG_QUIET, NULL);
+  kernel_set_scheduler(context, policy);
+  kernel_set_semaphores(context, semaphores, semaphores);
+  kernel_select(context);
+  clock = 0;
+  current_pid = 0;
+  initialize_kernel();
+
+  for (pid = 1; pid < processes; pid++)
+  {
+    R2 = pid;
+    R3 = 0;
+    handle_fork();
+  }
+  return context;
+}
+
+static double bench_enqueue(int processes, int depth, long ops)
+{
+  PROCESS_TABLE table;
+  PID_QUEUE queue = { NO_PID, NO_PID };
+  PID_type pid;
+  double start, ns;
+  long i;
+
+  // The queued processes are spread over the whole table
+
+  process_table_init(&table);
+  process_table = &table;
+  for (pid = 0; pid < processes; pid++)
+    process_create(pid);
+  for (i = 0; i < depth; i++)
+    enqueue(&queue, (PID_type) (i * processes / depth));
+
+  start = now_ns();
+  for (i = 0; i < ops; i++)
+    enqueue(&queue, dequeue(&queue));
+  ns = now_ns() - start;
+
+  process_table_free(&table);
+  process_table = NULL;
+  return ns;
+}
+
+static double bench_dispatch(long ops)
+{
+  double start = now_ns();
+  long i;
+
+  for (i = 0; i < ops; i++)
+  {
+    make_ready(current_pid);
+    schedule();
+  }
+  return now_ns() - start;
+}
+
+static double bench_clock(long ops)
+{
+  double start = now_ns();
+  long i;
+
+  for (i = 0; i < ops; i++)
+  {
+    clock += CLOCK_INTERRUPT_PERIOD;
+    handle_clock_interrupt();
+  }
+  return now_ns() - start;
+}
+
+static double bench_semaphore(int processes, int semaphores, long ops)
+{
+  BOOL *holding = (BOOL *) calloc(processes, sizeof(BOOL));
+  PID_type pid;
+  double start = now_ns(), ns;
+  long i;
+
+  // A process that is not holding its semaphore takes it (perhaps after
+  // waiting for it) and one that is gives it back
+
+  for (i = 0; i < ops; i++)
+  {
+    pid = current_pid;
+    R2 = pid % semaphores;
+    R3 = holding[pid] ? SEMAPHORE_UP : SEMAPHORE_DOWN;
+    holding[pid] = !holding[pid];
+    handle_semaphore();
+    if (R3 == SEMAPHORE_DOWN && current_pid == pid)
+    {
+      make_ready(current_pid);
+      schedule();
+    }
+  }
+  ns = now_ns() - start;
+  free(holding);
+  return ns;
+}
+
+static double bench_io(int processes, int depth, BOOL disk, long ops)
+{
+  PID_type *outstanding = (PID_type *) malloc(processes * sizeof(PID_type));
+  int head = 0, count = 0;
+  double start = now_ns(), ns;
+  long completed = 0;
+
+  while (completed < ops)
+  {
+    if (current_pid != IDLE_PROCESS && count < depth)
+    {
+      outstanding[(head + count++) % processes] = current_pid;
+      R2 = 1;
+      R3 = 0;
+      if (disk)
+        handle_disk_read();
+      else
+        handle_keyboard();
+    }
+    else
+    {
+      R1 = outstanding[head];
+      head = (head + 1) % processes;
+      count--;
+      if (disk)
+        handle_disk_interrupt();
+      else
+        handle_keyboard_interrupt();
+      completed++;
+    }
+  }
+  ns = now_ns() - start;
+  free(outstanding);
+  return ns;
+}
+
+static double bench_sleep(int processes, long ops)
+{
+  unsigned int seed = 1;
+  double start = now_ns();
+  long sleeps = 0;
+  long long longest;
+
+  // The sleeps are spread over every level of the timer wheel, up to
+  // 100 s. Every process sleeps about ops / processes times, for half the
+  // longest sleep on average, so with many sleeps per process they are
+  // kept shorter, for the clock to go no further than about 2^30 ms and
+  // never wrap (see kernel_next_deadline()).
+
+  longest = (1LL << 31) * processes / ops;
+  if (longest > 100000)
+    longest = 100000;
+  else if (longest < 1)
+    longest = 1;
+
+  while (sleeps < ops)
+  {
+    if (current_pid != IDLE_PROCESS)
+    {
+      seed = seed * 1103515245 + 12345;
+      R2 = 1 + (seed >> 8) % longest;
+      handle_sleep();
+      sleeps++;
+    }
+    else
+    {
+      clock = kernel_next_deadline();
+      handle_clock_interrupt();
+    }
+  }
+  return now_ns() - start;
+}
+
+static double bench_batch(KERNEL_CONTEXT *context, int size, long ops)
+{
+  BATCH_BUFFER *batch = kernel_batch(context);
+  double start = now_ns();
+  long done;
+  int i;
+
+  for (i = 0; i < size; i++)
+  {
+    batch->ops[i].trap = SEMAPHORE_OP;
+    batch->ops[i].arg = 0;
+    batch->ops[i].arg2 = SEMAPHORE_UP;
+  }
+
+  // An UP leaves R2 as it was, so the batch stays as it is
+
+  for (done = 0; done < ops; done += size)
+  {
+    R1 = size > 1 ? BATCH : SEMAPHORE_OP;
+    R2 = size > 1 ? size : 0;
+    R3 = SEMAPHORE_UP;
+    handle_trap();
+  }
+  return now_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+  int max_processes = 1000000, processes, policy, i, semaphores;
+  long ops = 1000000;
+  const char *name = NULL;
+  KERNEL_CONTEXT *context;
+  int arg;
+
+  for (arg = 1; arg < argc; arg++)
+  {
+    if (arg + 1 < argc && !strcmp(argv[arg], "-n") &&
+      sscanf(argv[arg + 1], "%d", &max_processes) == 1 && max_processes >= 10)
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-i") &&
+      sscanf(argv[arg + 1], "%ld", &ops) == 1 && ops > 0)
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-o"))
+      name = argv[++arg];
+    else
+    {
+      fprintf(stderr, "usage: %s [-n max processes] [-i operations] "
+        "[-o results file]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  out = stdout;
+  if (name != NULL && (out = fopen(name, "w")) == NULL)
+  {
+    perror(name);
+    return 1;
+  }
+  json = name != NULL && strlen(name) > 5 &&
+    !strcmp(name + strlen(name) - 5, ".json");
+  if (json)
+    fprintf(out, "[");
+  else
+    fprintf(out, "benchmark,policy,processes,depth,contention,ops,"
+      "ns_per_op,ops_per_sec\n");
+
+  for (processes = 10; processes <= max_processes; processes *= 10)
+  {
+    for (i = 0; i < (int) (sizeof(depths) / sizeof(depths[0])); i++)
+      if (depths[i] <= processes)
+        report("enqueue", SCHED_MLFQ, processes, depths[i], 0, ops,
+          bench_enqueue(processes, depths[i], ops));
+    report("enqueue", SCHED_MLFQ, processes, processes, 0, ops,
+      bench_enqueue(processes, processes, ops));
+
+    for (policy = 0; policy < NUMBER_OF_SCHED_POLICIES; policy++)
+    {
+      context = boot(processes, policy, 1);
+      report("dispatch", policy, processes, processes - 1, 0, ops,
+        bench_dispatch(ops));
+      kernel_destroy(context);
+
+      context = boot(processes, policy, 1);
+      report("clock", policy, processes, processes - 1, 0, ops,
+        bench_clock(ops));
+      kernel_destroy(context);
+    }
+
+    // Every process on one semaphore last
+
+    for (i = 0; i <= (int) (sizeof(contentions) / sizeof(contentions[0]));
+      i++)
+    {
+      semaphores = i < (int) (sizeof(contentions) / sizeof(contentions[0])) ?
+        processes / contentions[i] : 1;
+      if (i < (int) (sizeof(contentions) / sizeof(contentions[0])) &&
+        semaphores <= 1)
+        continue;
+      context = boot(processes, SCHED_MLFQ, semaphores);
+      report("semaphore", SCHED_MLFQ, processes, 0, processes / semaphores,
+        ops, bench_semaphore(processes, semaphores, ops));
+      kernel_destroy(context);
+    }
+
+    for (i = 0; i < (int) (sizeof(depths) / sizeof(depths[0])); i++)
+    {
+      context = boot(processes, SCHED_MLFQ, 1);
+      report("disk", SCHED_MLFQ, processes, depths[i], 0, ops,
+        bench_io(processes, depths[i], TRUE, ops));
+      kernel_destroy(context);
+
+      context = boot(processes, SCHED_MLFQ, 1);
+      report("keyboard", SCHED_MLFQ, processes, depths[i], 0, ops,
+        bench_io(processes, depths[i], FALSE, ops));
+      kernel_destroy(context);
+    }
+
+    context = boot(processes, SCHED_MLFQ, 1);
+    report("sleep", SCHED_MLFQ, processes, processes, 0, ops,
+      bench_sleep(processes, ops));
+    kernel_destroy(context);
+
+    for (i = 0; i < (int) (sizeof(batch_sizes) / sizeof(batch_sizes[0]));
+      i++)
+    {
+      context = boot(processes, SCHED_MLFQ, 1);
+      report("batch", SCHED_MLFQ, processes, batch_sizes[i], 0, ops,
+        bench_batch(context, batch_sizes[i], ops));
+      kernel_destroy(context);
+    }
+  }
+
+  if (json)
+    fprintf(out, "\n]\n");
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
@@ -0,0 +1,138 @@
+/* Compares the split (hot/links/cold) process table against the
+   array-of-structs layout it replaced, on the access patterns of the
+   kernel's hot paths:
+
+   scan    : read state and priority of every process (a full sweep)
+   dispatch: for random processes, check READY, mark RUNNING, adjust the
+             priority and mark READY again, as schedule() and the clock
+             and I/O interrupt handlers do
+
+   Usage: bench_layout [number of processes] [dispatches] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "hardware.h"
+#include "process_table.h"
+
+PID_type current_pid;
+CLOCK_TIME clock;
+
+// The layout before the split: one struct per process in a flat array
+
+typedef struct {
+  PROCESS_STATE state;
+  int total_CPU_time_used;
+  int priority;
+  PID_type next;
+  PID_type prev;
+} AOS_ENTRY;
+
+AOS_ENTRY *aos_table;
+
+static double now_ns()
+{
+  struct timeval tv;
+
+  // Not clock_gettime(): <time.h> clashes with the hardware's clock
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+// Small xorshift PRNG so both layouts see the same PID sequence
+
+static unsigned int rng_state;
+
+static unsigned int rng()
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+int main(int argc, char **argv)
+{
+  int processes = argc > 1 ? atoi(argv[1]) : 100000;
+  long dispatches = argc > 2 ? atol(argv[2]) : 10000000;
+  int scans = 100;
+  PROCESS_TABLE table;
+  long sink = 0;
+  double start, aos_scan, soa_scan, aos_dispatch, soa_dispatch;
+  PID_type pid;
+  long i;
+  int s;
+
+  process_table_init(&table);
+  process_table = &table;
+
+  aos_table = (AOS_ENTRY *) calloc(processes, sizeof(AOS_ENTRY));
+  for (pid = 0; pid < processes; pid++)
+  {
+    aos_table[pid].state = READY;
+    process_create(pid);
+  }
+
+  // Full sweeps over state and priority
+
+  start = now_ns();
+  for (s = 0; s < scans; s++)
+    for (pid = 0; pid < processes; pid++)
+      sink += (aos_table[pid].state == READY) * aos_table[pid].priority;
+  aos_scan = (now_ns() - start) / ((double) scans * processes);
+
+  start = now_ns();
+  for (s = 0; s < scans; s++)
+    for (pid = 0; pid < processes; pid += PROCESS_TABLE_PAGE_SIZE)
+    {
+      // Sweep a page's hot array at a time
+
+      PROCESS_HOT *hot = process_hot(pid);
+      int j, n = processes - pid < PROCESS_TABLE_PAGE_SIZE ?
+        processes - pid : PROCESS_TABLE_PAGE_SIZE;
+
+      for (j = 0; j < n; j++)
+        sink += (hot[j].state == READY) * hot[j].priority;
+    }
+  soa_scan = (now_ns() - start) / ((double) scans * processes);
+
+  // Random dispatch-style updates
+
+  rng_state = 2463534242u;
+  start = now_ns();
+  for (i = 0; i < dispatches; i++)
+  {
+    AOS_ENTRY *entry = &aos_table[rng() % processes];
+    if (entry->state == READY)
+    {
+      entry->state = RUNNING;
+      entry->priority = (entry->priority + 1) & 3;
+      entry->state = READY;
+    }
+  }
+  aos_dispatch = (now_ns() - start) / dispatches;
+
+  rng_state = 2463534242u;
+  start = now_ns();
+  for (i = 0; i < dispatches; i++)
+  {
+    PROCESS_HOT *hot = process_hot(rng() % processes);
+    if (hot->state == READY)
+    {
+      hot->state = RUNNING;
+      hot->priority = (hot->priority + 1) & 3;
+      hot->state = READY;
+    }
+  }
+  soa_dispatch = (now_ns() - start) / dispatches;
+
+  printf("processes: %d (%d bytes/process array-of-structs, %d hot)\n",
+    processes, (int) sizeof(AOS_ENTRY), (int) sizeof(PROCESS_HOT));
+  printf("scan     ns/process: array-of-structs %.3f  split %.3f\n",
+    aos_scan, soa_scan);
+  printf("dispatch ns/op     : array-of-structs %.3f  split %.3f\n",
+    aos_dispatch, soa_dispatch);
+  return sink == 42;
+}
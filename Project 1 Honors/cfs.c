@@ -0,0 +1,376 @@
+#include "hardware.h"
+#include "process_table.h"
+#include "scheduler.h"
+
+/* A completely fair scheduler, after Linux's CFS. Every process has a
+   virtual runtime: the CPU time it has used, scaled down by its weight
+   (see SET_NICE in kernel.h). The run queue keeps its READY processes in a
+   red-black tree ordered by virtual runtime and always runs the one that
+   has had least, so over time each gets CPU time in proportion to its
+   weight. Enqueueing and dequeueing take O(log n); the leftmost process is
+   cached, so picking the next one takes O(1). */
+
+// Weights of nice values MIN_NICE..MAX_NICE
+
+static const int nice_weights[MAX_NICE - MIN_NICE + 1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+  9548, 7620, 6100, 4904, 3906,
+  3121, 2501, 1991, 1586, 1277,
+  1024, 820, 655, 526, 423,
+  335, 272, 215, 172, 137,
+  110, 87, 70, 56, 45,
+  36, 29, 23, 18, 15
+};
+
+#define NICE_0_WEIGHT 1024
+
+static int weight(PID_type pid)
+{
+  return nice_weights[process_sched(pid)->nice - MIN_NICE];
+}
+
+// Tree order: virtual runtime, then PID so that keys are unique
+
+static BOOL before(PID_type a, PID_type b)
+{
+  PROCESS_SCHED *sa = process_sched(a), *sb = process_sched(b);
+
+  return sa->vruntime < sb->vruntime ||
+    (sa->vruntime == sb->vruntime && a < b);
+}
+
+static BOOL is_red(PID_type pid)
+{
+  return pid != NO_PID && process_sched(pid)->red;
+}
+
+// Puts child where pid was under pid's parent
+
+static void replace_child(CFS_QUEUE *tree, PID_type pid, PID_type child)
+{
+  PID_type parent = process_sched(pid)->parent;
+
+  if (parent == NO_PID)
+    tree->root = child;
+  else if (process_sched(parent)->left == pid)
+    process_sched(parent)->left = child;
+  else
+    process_sched(parent)->right = child;
+  if (child != NO_PID)
+    process_sched(child)->parent = parent;
+}
+
+static void rotate_left(CFS_QUEUE *tree, PID_type pid)
+{
+  PROCESS_SCHED *node = process_sched(pid);
+  PID_type right = node->right;
+  PROCESS_SCHED *right_node = process_sched(right);
+
+  node->right = right_node->left;
+  if (right_node->left != NO_PID)
+    process_sched(right_node->left)->parent = pid;
+  replace_child(tree, pid, right);
+  right_node->left = pid;
+  node->parent = right;
+}
+
+static void rotate_right(CFS_QUEUE *tree, PID_type pid)
+{
+  PROCESS_SCHED *node = process_sched(pid);
+  PID_type left = node->left;
+  PROCESS_SCHED *left_node = process_sched(left);
+
+  node->left = left_node->right;
+  if (left_node->right != NO_PID)
+    process_sched(left_node->right)->parent = pid;
+  replace_child(tree, pid, left);
+  left_node->right = pid;
+  node->parent = left;
+}
+
+static void tree_insert(CFS_QUEUE *tree, PID_type pid)
+{
+  PROCESS_SCHED *node = process_sched(pid);
+  PID_type parent = NO_PID, at = tree->root, grandparent, uncle;
+  BOOL leftmost = TRUE, left = FALSE;
+
+  while (at != NO_PID)
+  {
+    parent = at;
+    if ((left = before(pid, at)))
+      at = process_sched(at)->left;
+    else
+    {
+      at = process_sched(at)->right;
+      leftmost = FALSE;
+    }
+  }
+
+  node->parent = parent;
+  node->left = NO_PID;
+  node->right = NO_PID;
+  node->red = TRUE;
+  if (parent == NO_PID)
+    tree->root = pid;
+  else if (left)
+    process_sched(parent)->left = pid;
+  else
+    process_sched(parent)->right = pid;
+  if (leftmost)
+    tree->leftmost = pid;
+
+  // Restore the red-black properties: no red node has a red child
+
+  while (is_red(parent = process_sched(pid)->parent))
+  {
+    grandparent = process_sched(parent)->parent;
+    if (parent == process_sched(grandparent)->left)
+    {
+      uncle = process_sched(grandparent)->right;
+      if (is_red(uncle))
+      {
+        process_sched(parent)->red = FALSE;
+        process_sched(uncle)->red = FALSE;
+        process_sched(grandparent)->red = TRUE;
+        pid = grandparent;
+        continue;
+      }
+      if (pid == process_sched(parent)->right)
+      {
+        rotate_left(tree, parent);
+        parent = pid;
+      }
+      process_sched(parent)->red = FALSE;
+      process_sched(grandparent)->red = TRUE;
+      rotate_right(tree, grandparent);
+      break;
+    }
+    else
+    {
+      uncle = process_sched(grandparent)->left;
+      if (is_red(uncle))
+      {
+        process_sched(parent)->red = FALSE;
+        process_sched(uncle)->red = FALSE;
+        process_sched(grandparent)->red = TRUE;
+        pid = grandparent;
+        continue;
+      }
+      if (pid == process_sched(parent)->left)
+      {
+        rotate_right(tree, parent);
+        parent = pid;
+      }
+      process_sched(parent)->red = FALSE;
+      process_sched(grandparent)->red = TRUE;
+      rotate_left(tree, grandparent);
+      break;
+    }
+  }
+  process_sched(tree->root)->red = FALSE;
+}
+
+static PID_type tree_first(PID_type pid)
+{
+  while (process_sched(pid)->left != NO_PID)
+    pid = process_sched(pid)->left;
+  return pid;
+}
+
+static void tree_remove(CFS_QUEUE *tree, PID_type pid)
+{
+  PROCESS_SCHED *node = process_sched(pid);
+  PID_type child, parent, moved, sibling;
+  BOOL removed_red;
+
+  // The next leftmost is the removed one's right subtree's first process,
+  // or its parent
+
+  if (tree->leftmost == pid)
+    tree->leftmost = node->right != NO_PID ? tree_first(node->right) :
+      node->parent;
+
+  // Unlink pid, or, if it has two children, move its successor into its
+  // place. child takes the place of whichever node left the tree.
+
+  if (node->left == NO_PID || node->right == NO_PID)
+  {
+    child = node->left != NO_PID ? node->left : node->right;
+    parent = node->parent;
+    removed_red = node->red;
+    replace_child(tree, pid, child);
+  }
+  else
+  {
+    moved = tree_first(node->right);
+    child = process_sched(moved)->right;
+    removed_red = process_sched(moved)->red;
+    if (process_sched(moved)->parent == pid)
+      parent = moved;
+    else
+    {
+      parent = process_sched(moved)->parent;
+      replace_child(tree, moved, child);
+      process_sched(moved)->right = node->right;
+      process_sched(node->right)->parent = moved;
+    }
+    replace_child(tree, pid, moved);
+    process_sched(moved)->left = node->left;
+    process_sched(node->left)->parent = moved;
+    process_sched(moved)->red = node->red;
+  }
+
+  if (removed_red)
+    return;
+
+  // A black node left the tree: child's paths are one black node short
+
+  while (child != tree->root && !is_red(child))
+  {
+    if (child == process_sched(parent)->left)
+    {
+      sibling = process_sched(parent)->right;
+      if (is_red(sibling))
+      {
+        process_sched(sibling)->red = FALSE;
+        process_sched(parent)->red = TRUE;
+        rotate_left(tree, parent);
+        sibling = process_sched(parent)->right;
+      }
+      if (!is_red(process_sched(sibling)->left) &&
+        !is_red(process_sched(sibling)->right))
+      {
+        process_sched(sibling)->red = TRUE;
+        child = parent;
+        parent = process_sched(child)->parent;
+        continue;
+      }
+      if (!is_red(process_sched(sibling)->right))
+      {
+        process_sched(process_sched(sibling)->left)->red = FALSE;
+        process_sched(sibling)->red = TRUE;
+        rotate_right(tree, sibling);
+        sibling = process_sched(parent)->right;
+      }
+      process_sched(sibling)->red = process_sched(parent)->red;
+      process_sched(parent)->red = FALSE;
+      process_sched(process_sched(sibling)->right)->red = FALSE;
+      rotate_left(tree, parent);
+    }
+    else
+    {
+      sibling = process_sched(parent)->left;
+      if (is_red(sibling))
+      {
+        process_sched(sibling)->red = FALSE;
+        process_sched(parent)->red = TRUE;
+        rotate_right(tree, parent);
+        sibling = process_sched(parent)->left;
+      }
+      if (!is_red(process_sched(sibling)->left) &&
+        !is_red(process_sched(sibling)->right))
+      {
+        process_sched(sibling)->red = TRUE;
+        child = parent;
+        parent = process_sched(child)->parent;
+        continue;
+      }
+      if (!is_red(process_sched(sibling)->left))
+      {
+        process_sched(process_sched(sibling)->right)->red = FALSE;
+        process_sched(sibling)->red = TRUE;
+        rotate_left(tree, sibling);
+        sibling = process_sched(parent)->left;
+      }
+      process_sched(sibling)->red = process_sched(parent)->red;
+      process_sched(parent)->red = FALSE;
+      process_sched(process_sched(sibling)->left)->red = FALSE;
+      rotate_right(tree, parent);
+    }
+    child = tree->root;
+  }
+  if (child != NO_PID)
+    process_sched(child)->red = FALSE;
+}
+
+static void cfs_init(RUN_QUEUE *run_queue)
+{
+  run_queue->cfs.root = NO_PID;
+  run_queue->cfs.leftmost = NO_PID;
+  run_queue->cfs.min_vruntime = 0;
+  run_queue->cfs.weight = 0;
+}
+
+static void cfs_destroy(RUN_QUEUE *run_queue)
+{
+}
+
+static void cfs_on_wake(RUN_QUEUE *run_queue, PID_type pid)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+  long long floor = run_queue->cfs.min_vruntime -
+    ((long long) CFS_WAKEUP_CREDIT << 10);
+
+  // New processes start, and sleepers come back, no more than the credit
+  // behind the others; a process moving here from a CPU that is further
+  // behind catches up the same way
+
+  if (sched->vruntime < floor)
+    sched->vruntime = floor;
+}
+
+static void cfs_enqueue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  tree_insert(&run_queue->cfs, pid);
+  run_queue->cfs.weight += weight(pid);
+}
+
+static PID_type cfs_pick_next(RUN_QUEUE *run_queue)
+{
+  return run_queue->cfs.leftmost;
+}
+
+static void cfs_dequeue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  tree_remove(&run_queue->cfs, pid);
+  run_queue->cfs.weight -= weight(pid);
+
+  // What runs is (about) the least run process, which moves the minimum on
+
+  if (process_sched(pid)->vruntime > run_queue->cfs.min_vruntime)
+    run_queue->cfs.min_vruntime = process_sched(pid)->vruntime;
+}
+
+static int cfs_time_slice(RUN_QUEUE *run_queue, PID_type pid)
+{
+  int slice = (long long) CFS_LATENCY * weight(pid) /
+    (run_queue->cfs.weight + weight(pid));
+
+  return slice > CFS_MIN_GRANULARITY ? slice : CFS_MIN_GRANULARITY;
+}
+
+static void cfs_tick(RUN_QUEUE *run_queue, PID_type pid, int ran,
+  BOOL expired)
+{
+  process_sched(pid)->vruntime +=
+    ((long long) ran << 10) * NICE_0_WEIGHT / weight(pid);
+}
+
+static void cfs_on_block(RUN_QUEUE *run_queue, PID_type pid, BOOL early)
+{
+}
+
+const SCHED_POLICY cfs_policy = {
+  "cfs",
+  FALSE,
+  cfs_init,
+  cfs_destroy,
+  cfs_on_wake,
+  cfs_enqueue,
+  cfs_pick_next,
+  cfs_dequeue,
+  cfs_time_slice,
+  cfs_tick,
+  cfs_on_block
+};
@@ -0,0 +1,257 @@
+#include <stdlib.h>
+
+#include "hardware.h"
+#include "drivers.h"
+#include "process_table.h"
+#include "disk.h"
+
+static void append(DISK *disk, REQUEST_LIST *list, int request)
+{
+  disk->pool[request].next = NO_REQUEST;
+  disk->pool[request].prev = list->tail;
+  if (list->tail == NO_REQUEST)
+    list->head = request;
+  else
+    disk->pool[list->tail].next = request;
+  list->tail = request;
+}
+
+static void unlink_request(DISK *disk, REQUEST_LIST *list, int request)
+{
+  DISK_REQUEST *r = &disk->pool[request];
+
+  if (r->prev == NO_REQUEST)
+    list->head = r->next;
+  else
+    disk->pool[r->prev].next = r->next;
+  if (r->next == NO_REQUEST)
+    list->tail = r->prev;
+  else
+    disk->pool[r->next].prev = r->prev;
+}
+
+// How far a read is from the head (a read whose block is unknown is at
+// the head)
+
+static int distance_to(DISK *disk, int request)
+{
+  if (disk->pool[request].block == NO_BLOCK)
+    return 0;
+  return abs(disk->pool[request].block - disk->head);
+}
+
+// Chooses the queued read to serve next
+
+static int pick(DISK *disk)
+{
+  int request, best = disk->queue.head;
+  int distance, best_distance;
+
+  if (disk->policy == DISK_FIFO)
+    return best;
+  if (disk->policy == DISK_DEADLINE &&
+    clock - disk->pool[best].since >= DISK_DEADLINE_TIME)
+    return best;
+
+  best_distance = distance_to(disk, best);
+  for (request = disk->pool[best].next; request != NO_REQUEST;
+    request = disk->pool[request].next)
+  {
+    distance = distance_to(disk, request);
+    if (distance < best_distance)
+    {
+      best = request;
+      best_distance = distance;
+    }
+  }
+  return best;
+}
+
+// Sends the next request, with every read that merges into it, to the
+// driver
+
+static void dispatch(DISK *disk)
+{
+  int first, request, next;
+  int start, end, read_start, read_end;
+  BOOL merged = TRUE;
+
+  if (disk->queue.head == NO_REQUEST)
+    return;
+
+  first = pick(disk);
+  unlink_request(disk, &disk->queue, first);
+  append(disk, &disk->in_flight, first);
+  start = disk->pool[first].block;
+  end = start + disk->pool[first].size;
+
+  // A read whose block is unknown goes alone, and leaves the head where
+  // it was
+
+  if (start == NO_BLOCK)
+  {
+    disk->requests++;
+    disk_read_req(disk->pool[first].pid, disk->pool[first].size);
+    return;
+  }
+
+  // Keep sweeping the queue while reads still merge: each one can make the
+  // request reach further ones
+
+  while (merged)
+  {
+    merged = FALSE;
+    for (request = disk->queue.head; request != NO_REQUEST; request = next)
+    {
+      next = disk->pool[request].next;
+      if (disk->pool[request].block == NO_BLOCK)
+        continue;
+      read_start = disk->pool[request].block;
+      read_end = read_start + disk->pool[request].size;
+
+      // Only reads that overlap or adjoin the request, and keep it within
+      // DISK_MAX_MERGE_BLOCKS, merge
+
+      if (read_start > end || read_end < start ||
+        (read_end > end ? read_end : end) -
+        (read_start < start ? read_start : start) > DISK_MAX_MERGE_BLOCKS)
+        continue;
+
+      if (read_start < start)
+        start = read_start;
+      if (read_end > end)
+        end = read_end;
+      unlink_request(disk, &disk->queue, request);
+      append(disk, &disk->in_flight, request);
+      merged = TRUE;
+    }
+  }
+
+  disk->head = end;
+  disk->requests++;
+  disk_read_req(disk->pool[first].pid, end - start);
+}
+
+void disk_init(DISK *disk, DISK_POLICY policy)
+{
+  disk->policy = policy;
+  disk->pool = NULL;
+  disk->pool_size = 0;
+  disk->free_head = NO_REQUEST;
+  disk->queue.head = NO_REQUEST;
+  disk->queue.tail = NO_REQUEST;
+  disk->in_flight.head = NO_REQUEST;
+  disk->in_flight.tail = NO_REQUEST;
+  disk->head = 0;
+  disk->reads = 0;
+  disk->requests = 0;
+}
+
+void disk_free(DISK *disk)
+{
+  free(disk->pool);
+  disk->pool = NULL;
+  disk->pool_size = 0;
+  disk->free_head = NO_REQUEST;
+}
+
+int disk_submit(DISK *disk, PID_type pid, int size, int block, BOOL async)
+{
+  int request, i, old_size = disk->pool_size;
+
+  // Double the pool when it runs out
+
+  if (disk->free_head == NO_REQUEST)
+  {
+    disk->pool_size = old_size ? old_size * 2 : 64;
+    disk->pool = (DISK_REQUEST *) realloc(disk->pool,
+      disk->pool_size * sizeof(DISK_REQUEST));
+    for (i = disk->pool_size - 1; i >= old_size; i--)
+    {
+      disk->pool[i].next = disk->free_head;
+      disk->free_head = i;
+    }
+  }
+
+  request = disk->free_head;
+  disk->free_head = disk->pool[request].next;
+  disk->pool[request].pid = pid;
+  disk->pool[request].block = block >= 0 ? block : NO_BLOCK;
+  disk->pool[request].size = size;
+  disk->pool[request].since = clock;
+  disk->pool[request].async = async;
+  disk->pool[request].orphaned = FALSE;
+  disk->reads++;
+
+  if (disk->policy == DISK_PASSTHROUGH)
+  {
+    append(disk, &disk->in_flight, request);
+    disk->requests++;
+    disk_read_req(pid, size);
+    return request;
+  }
+
+  append(disk, &disk->queue, request);
+  if (disk->in_flight.head == NO_REQUEST)
+    dispatch(disk);
+  return request;
+}
+
+void disk_complete(DISK *disk, PID_type pid, REQUEST_LIST *done)
+{
+  int request;
+
+  done->head = NO_REQUEST;
+  done->tail = NO_REQUEST;
+
+  // Without the scheduler several reads can be out at once: the oldest one
+  // of the process finished
+
+  if (disk->policy == DISK_PASSTHROUGH)
+  {
+    for (request = disk->in_flight.head; request != NO_REQUEST;
+      request = disk->pool[request].next)
+      if (disk->pool[request].pid == pid)
+        break;
+    if (request != NO_REQUEST)
+    {
+      unlink_request(disk, &disk->in_flight, request);
+      append(disk, done, request);
+    }
+    return;
+  }
+
+  *done = disk->in_flight;
+  disk->in_flight.head = NO_REQUEST;
+  disk->in_flight.tail = NO_REQUEST;
+  dispatch(disk);
+}
+
+int disk_pop(DISK *disk, REQUEST_LIST *list)
+{
+  int request = list->head;
+
+  if (request != NO_REQUEST)
+    unlink_request(disk, list, request);
+  return request;
+}
+
+void disk_release(DISK *disk, int request)
+{
+  disk->pool[request].next = disk->free_head;
+  disk->free_head = request;
+}
+
+void disk_orphan(DISK *disk, PID_type pid)
+{
+  int request;
+
+  for (request = disk->queue.head; request != NO_REQUEST;
+    request = disk->pool[request].next)
+    if (disk->pool[request].pid == pid)
+      disk->pool[request].orphaned = TRUE;
+  for (request = disk->in_flight.head; request != NO_REQUEST;
+    request = disk->pool[request].next)
+    if (disk->pool[request].pid == pid)
+      disk->pool[request].orphaned = TRUE;
+}
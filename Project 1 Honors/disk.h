@@ -0,0 +1,124 @@
+
+/* The disk request scheduler, between the kernel and disk_read_req().
+
+   By default (DISK_PASSTHROUGH) every read goes straight to the driver,
+   as it always has. With any other policy the kernel keeps the disk's
+   reads in its own request queue and has one request at a time out at
+   the driver. When the disk finishes, the policy picks the next read and
+   every queued read whose blocks overlap or adjoin it is merged in, so
+   they go to the driver as one request, covering all their blocks, and
+   pay DISK_READ_OVERHEAD once. The merged request is issued for its
+   first read's process; its interrupt completes all of them.
+
+   A read covers blocks [block, block + size). The supplied hardware only
+   gives the size (in R2); a hardware model that knows where reads are on
+   the disk puts the first block in R3, and NO_BLOCK otherwise (see
+   kernel_set_full_registers() in kernel.h). A read whose block is unknown
+   is never merged, since nothing says its blocks are anyone else's, and
+   SSTF and deadline count it as being at the head.
+
+   The driver charges DISK_READ_OVERHEAD plus the blocks read, with no
+   seek time, so where the head is makes no difference to how long a read
+   takes. SSTF and deadline therefore bring no seek benefit: all they
+   change is the order reads are served in, and so which reads are queued
+   together and merge. Only merging saves disk time.
+
+   Reads are kept in a pool of DISK_REQUESTs, linked into the queue, the
+   list of reads out at the driver or the free list. The pool only grows
+   when more reads than ever before are outstanding, so submitting and
+   completing reads does not allocate. A process can have several reads
+   outstanding (see DISK_READ_ASYNC in kernel.h); the driver reports
+   which process's read finished, and a process's reads are assumed to
+   finish in the order they went to the driver. */
+
+typedef enum {
+  DISK_PASSTHROUGH,  /* no queue: every read goes to the driver at once */
+  DISK_FIFO,         /* oldest read first */
+  DISK_SSTF,         /* read nearest the head first (oldest on ties) */
+  DISK_DEADLINE      /* SSTF, but a read queued for DISK_DEADLINE_TIME ms
+                        or more goes first */
+} DISK_POLICY;
+
+#define DISK_DEADLINE_TIME 500
+
+// Largest merged request, in blocks
+
+#define DISK_MAX_MERGE_BLOCKS 256
+
+// Marks a read whose first block is unknown
+
+#define NO_BLOCK -1
+
+// Marks the end of a list of requests
+
+#define NO_REQUEST -1
+
+typedef struct {
+  PID_type pid;
+  int block;         // NO_BLOCK if unknown
+  int size;
+  CLOCK_TIME since;  // when it was submitted
+  BOOL async;        // the process did not block for it
+  BOOL orphaned;     // the process exited before it finished
+  int next;
+  int prev;
+} DISK_REQUEST;
+
+typedef struct {
+  int head;
+  int tail;
+} REQUEST_LIST;
+
+typedef struct {
+  DISK_POLICY policy;
+
+  // The request pool and its unused entries
+
+  DISK_REQUEST *pool;
+  int pool_size;
+  int free_head;
+
+  // Queued reads, oldest first, and the reads out at the driver
+
+  REQUEST_LIST queue;
+  REQUEST_LIST in_flight;
+
+  // The block after the last one read
+
+  int head;
+
+  // Statistics: reads submitted and requests sent to the driver
+
+  int reads;
+  int requests;
+} DISK;
+
+// Sets up an idle disk with an empty queue
+
+void disk_init(DISK *disk, DISK_POLICY policy);
+
+// Frees a disk's request pool
+
+void disk_free(DISK *disk);
+
+// Submits a read for a process and returns its request
+
+int disk_submit(DISK *disk, PID_type pid, int size, int block, BOOL async);
+
+// Handles the disk's interrupt for a read of pid: moves the reads it
+// completed to done (oldest first) and sends the next request to the
+// driver. The kernel returns them with disk_release() once handled.
+
+void disk_complete(DISK *disk, PID_type pid, REQUEST_LIST *done);
+
+// Takes the first request off a list (NO_REQUEST if it is empty)
+
+int disk_pop(DISK *disk, REQUEST_LIST *list);
+
+// Returns a handled request to the pool
+
+void disk_release(DISK *disk, int request);
+
+// Marks every outstanding read of an exiting process as orphaned
+
+void disk_orphan(DISK *disk, PID_type pid);
@@ -0,0 +1,36 @@
+/* Turns a binary kernel event log back into the kernel's text messages.
+
+   Usage: event_decode [log file]      (standard input by default) */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware.h"
+#include "event_log.h"
+
+int main(int argc, char **argv)
+{
+  static EVENT_RECORD records[EVENT_LOG_CAPACITY];
+  char magic[sizeof(EVENT_LOG_MAGIC)];
+  FILE *in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+  size_t count, i;
+
+  if (in == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+    memcmp(magic, EVENT_LOG_MAGIC, sizeof(magic)))
+  {
+    fprintf(stderr, "not a kernel event log\n");
+    return 1;
+  }
+
+  while ((count = fread(records, sizeof(EVENT_RECORD), EVENT_LOG_CAPACITY,
+    in)) > 0)
+    for (i = 0; i < count; i++)
+      event_format(stdout, &records[i]);
+  return 0;
+}
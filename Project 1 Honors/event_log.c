@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware.h"
+#include "event_log.h"
+
+void event_log_init(EVENT_LOG *log, FILE *file)
+{
+  log->head = 0;
+  log->tail = 0;
+  log->file = file;
+  fwrite(EVENT_LOG_MAGIC, 1, sizeof(EVENT_LOG_MAGIC), file);
+}
+
+void event_log_put(EVENT_LOG *log, const EVENT_RECORD *record)
+{
+  if (log->head - log->tail == EVENT_LOG_CAPACITY)
+    event_log_drain(log);
+
+  log->records[log->head++ & (EVENT_LOG_CAPACITY - 1)] = *record;
+}
+
+int event_log_drain(EVENT_LOG *log)
+{
+  unsigned int start = log->tail & (EVENT_LOG_CAPACITY - 1);
+  unsigned int count = log->head - log->tail;
+  unsigned int first = count;
+
+  if (!count)
+    return 0;
+
+  // The pending records may wrap around the end of the buffer
+
+  if (start + count > EVENT_LOG_CAPACITY)
+    first = EVENT_LOG_CAPACITY - start;
+  fwrite(&log->records[start], sizeof(EVENT_RECORD), first, log->file);
+  fwrite(&log->records[0], sizeof(EVENT_RECORD), count - first, log->file);
+
+  log->tail = log->head;
+  return count;
+}
+
+void event_format(FILE *out, const EVENT_RECORD *record)
+{
+  CLOCK_TIME time = record->time;
+  int pid = record->pid;
+
+  switch (record->type)
+  {
+    case EVENT_DISK_WRITE:
+      fprintf(out, "Time %u: Process %d issues disk write request\n",
+        time, pid);
+      break;
+    case EVENT_DISK_READ:
+      fprintf(out, "Time %u: Process %d issues disk read request\n",
+        time, pid);
+      break;
+    case EVENT_KEYBOARD_READ:
+      fprintf(out, "Time %u: Process %d issues keyboard read request\n",
+        time, pid);
+      break;
+    case EVENT_FORK:
+      fprintf(out, "Time %u: Creating process entry for pid %d\n", time, pid);
+      break;
+    case EVENT_FORK_INVALID:
+      fprintf(out, "Time %u: Process %d cannot create process %d, the PID "
+        "is in use or out of range\n", time, pid, record->arg);
+      break;
+    case EVENT_EXIT:
+      fprintf(out, "Time %u: Process %d exits. Total CPU time = %d\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_SEMAPHORE_UP:
+      fprintf(out, "Time %u: Process %d issues UP operation on semaphore %d\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_SEMAPHORE_DOWN:
+      fprintf(out,
+        "Time %u: Process %d issues DOWN operation on semaphore %d\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_DISK_INTERRUPT:
+      fprintf(out, "Time %u: Handled DISK_INTERRUPT for pid %d\n", time, pid);
+      break;
+    case EVENT_KEYBOARD_INTERRUPT:
+      fprintf(out, "Time %u: Handled KEYBOARD_INTERRUPT for pid %d\n",
+        time, pid);
+      break;
+    case EVENT_RUN:
+      fprintf(out, "Time %u: Process %d runs\n", time, pid);
+      break;
+    case EVENT_IDLE:
+      fprintf(out, "Time %u: Processor is idle\n", time);
+      break;
+    case EVENT_FINISHED:
+      fprintf(out, "-- No more processes to execute --\n");
+      break;
+    case EVENT_DEADLOCK:
+      fprintf(out, "DEADLOCKED SYSTEM\n");
+      break;
+    case EVENT_SEMAPHORE_CREATE:
+      if (record->arg < 0)
+        fprintf(out, "Time %u: Process %d cannot create a semaphore, none "
+          "is free\n", time, pid);
+      else
+        fprintf(out, "Time %u: Process %d creates semaphore %d\n", time,
+          pid, record->arg);
+      break;
+    case EVENT_SEMAPHORE_DESTROY:
+      fprintf(out, "Time %u: Process %d destroys semaphore %d\n", time, pid,
+        record->arg);
+      break;
+    case EVENT_SEMAPHORE_INVALID:
+      fprintf(out, "Time %u: Process %d uses invalid semaphore %d\n", time,
+        pid, record->arg);
+      break;
+    case EVENT_SEMAPHORE_BUSY:
+      fprintf(out, "Time %u: Process %d cannot destroy semaphore %d, "
+        "processes are waiting on it\n", time, pid, record->arg);
+      break;
+    case EVENT_SEMAPHORE_BAD_VALUE:
+      fprintf(out, "Time %u: Process %d cannot create a semaphore with "
+        "negative value %d\n", time, pid, record->arg);
+      break;
+    case EVENT_DEADLOCK_CYCLE:
+      fprintf(out, "Time %u: Deadlock cycle of length %d, each process "
+        "waiting on a semaphore last taken by the next:\n", time,
+        record->arg);
+      break;
+    case EVENT_DISK_READ_ASYNC:
+      fprintf(out, "Time %u: Process %d issues asynchronous disk read "
+        "request\n", time, pid);
+      break;
+    case EVENT_DISK_QUEUE_FULL:
+      fprintf(out, "Time %u: Process %d cannot issue asynchronous disk read "
+        "request, %d reads are outstanding\n", time, pid, record->arg);
+      break;
+    case EVENT_DISK_WAIT:
+      fprintf(out, "Time %u: Process %d waits for %d disk reads\n", time,
+        pid, record->arg);
+      break;
+    case EVENT_DISK_REAP:
+      fprintf(out, "Time %u: Process %d reaps %d disk reads\n", time, pid,
+        record->arg);
+      break;
+    case EVENT_SET_NICE:
+      fprintf(out, "Time %u: Process %d sets its nice value to %d\n", time,
+        pid, record->arg);
+      break;
+    case EVENT_SLEEP:
+      fprintf(out, "Time %u: Process %d sleeps for %d ms\n", time, pid,
+        record->arg);
+      break;
+    case EVENT_WAKE:
+      fprintf(out, "Time %u: Process %d wakes up\n", time, pid);
+      break;
+    case EVENT_SEMAPHORE_TIMEOUT:
+      fprintf(out, "Time %u: Process %d times out on semaphore %d\n", time,
+        pid, record->arg);
+      break;
+    case EVENT_GROUP_CREATE:
+      if (record->arg < 0)
+        fprintf(out, "Time %u: Process %d cannot create a group, its own "
+          "is too deep\n", time, pid);
+      else
+        fprintf(out, "Time %u: Process %d creates group %d\n", time, pid,
+          record->arg);
+      break;
+    case EVENT_GROUP_JOIN:
+      fprintf(out, "Time %u: Process %d joins group %d\n", time, pid,
+        record->arg);
+      break;
+    case EVENT_GROUP_INVALID:
+      fprintf(out, "Time %u: Process %d uses invalid group %d\n", time, pid,
+        record->arg);
+      break;
+    case EVENT_THROTTLE:
+      fprintf(out, "Time %u: Process %d is throttled, group %d is over its "
+        "quota\n", time, pid, record->arg);
+      break;
+    case EVENT_UNTHROTTLE:
+      fprintf(out, "Time %u: Process %d is unthrottled\n", time, pid);
+      break;
+    case EVENT_REALTIME_ADMIT:
+      fprintf(out, "Time %u: Process %d becomes real-time, real-time "
+        "processes now use %d.%02d%% of a CPU\n", time, pid,
+        record->arg / 100, record->arg % 100);
+      break;
+    case EVENT_REALTIME_REJECT:
+      fprintf(out, "Time %u: Process %d cannot become real-time, there is "
+        "no room\n", time, pid);
+      break;
+    case EVENT_REALTIME_INVALID:
+      fprintf(out, "Time %u: Process %d cannot become real-time, its "
+        "runtime, deadline and period are out of order\n", time, pid);
+      break;
+    case EVENT_REALTIME_LEAVE:
+      fprintf(out, "Time %u: Process %d is no longer real-time\n", time,
+        pid);
+      break;
+    case EVENT_DEADLINE_MISS:
+      fprintf(out, "Time %u: Process %d misses its deadline by %d ms\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_BUDGET_THROTTLE:
+      fprintf(out, "Time %u: Process %d is throttled, its real-time budget "
+        "is used up until %d\n", time, pid, record->arg);
+      break;
+    case EVENT_RWLOCK_READ:
+      fprintf(out, "Time %u: Process %d locks rwlock %d for reading\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_RWLOCK_WRITE:
+      fprintf(out, "Time %u: Process %d locks rwlock %d for writing\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_RWLOCK_UNLOCK:
+      fprintf(out, "Time %u: Process %d unlocks rwlock %d\n", time, pid,
+        record->arg);
+      break;
+    case EVENT_RWLOCK_GRANT:
+      fprintf(out, "Time %u: Process %d gets rwlock %d\n", time, pid,
+        record->arg);
+      break;
+    case EVENT_RWLOCK_INVALID:
+      fprintf(out, "Time %u: Process %d uses invalid rwlock %d\n", time,
+        pid, record->arg);
+      break;
+    case EVENT_CONDVAR_WAIT:
+      fprintf(out, "Time %u: Process %d waits on condition variable %d\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_CONDVAR_SIGNAL:
+      fprintf(out, "Time %u: Process %d signals condition variable %d\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_CONDVAR_BROADCAST:
+      fprintf(out, "Time %u: Process %d broadcasts condition variable %d\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_CONDVAR_WAKE:
+      fprintf(out, "Time %u: Process %d is woken from condition variable "
+        "%d\n", time, pid, record->arg);
+      break;
+    case EVENT_CONDVAR_INVALID:
+      fprintf(out, "Time %u: Process %d uses invalid condition variable "
+        "%d\n", time, pid, record->arg);
+      break;
+    case EVENT_BATCH:
+      fprintf(out, "Time %u: Process %d issues a batch of %d operations\n",
+        time, pid, record->arg);
+      break;
+    case EVENT_SHARE:
+      fprintf(out, "Time %u: Process %d got %d.%02d%% of the CPU, asked for "
+        "%d.%02d%%\n", time, pid, (record->arg >> 16) / 100,
+        (record->arg >> 16) % 100, (record->arg & 0xFFFF) / 100,
+        (record->arg & 0xFFFF) % 100);
+      break;
+    case EVENT_DEADLOCK_WAIT:
+      fprintf(out, "Time %u:   Process %d waits on semaphore %d\n", time,
+        pid, record->arg);
+      break;
+  }
+}
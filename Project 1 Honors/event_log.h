@@ -0,0 +1,125 @@
+
+/* The kernel reports what it does as fixed-size binary event records
+   rather than formatting a line of text for every trap and interrupt.
+   Depending on the kernel's log mode (see kernel_set_log() in kernel.h)
+   a record is either formatted straight away, exactly as the kernel used
+   to print it, or put in an EVENT_LOG ring buffer and written out in
+   binary; event_decode turns such a file back into the same text.
+
+   A binary log file is the 8 byte EVENT_LOG_MAGIC followed by the records,
+   in the byte order of the machine that wrote them. */
+
+#define EVENT_LOG_MAGIC "KEVLOG1"
+
+typedef enum {
+  EVENT_DISK_WRITE,         /* pid issued a disk write */
+  EVENT_DISK_READ,          /* pid issued a disk read */
+  EVENT_KEYBOARD_READ,      /* pid issued a keyboard read */
+  EVENT_FORK,               /* process entry created for pid */
+  EVENT_FORK_INVALID,       /* pid could not create process arg, its PID
+                               being in use or out of range */
+  EVENT_EXIT,               /* pid exited, arg = total CPU time */
+  EVENT_SEMAPHORE_UP,       /* pid did UP on semaphore arg */
+  EVENT_SEMAPHORE_DOWN,     /* pid did DOWN on semaphore arg */
+  EVENT_DISK_INTERRUPT,     /* disk read of pid completed */
+  EVENT_KEYBOARD_INTERRUPT, /* keyboard read of pid completed */
+  EVENT_RUN,                /* pid dispatched */
+  EVENT_IDLE,               /* processor went idle */
+  EVENT_FINISHED,           /* no processes left */
+  EVENT_DEADLOCK,           /* processes left but none can run */
+  EVENT_SEMAPHORE_CREATE,   /* pid created semaphore arg (NO_SEMAPHORE if
+                               none was free) */
+  EVENT_SEMAPHORE_DESTROY,  /* pid destroyed semaphore arg */
+  EVENT_SEMAPHORE_INVALID,  /* pid used semaphore arg, which is not open */
+  EVENT_SEMAPHORE_BUSY,     /* pid could not destroy semaphore arg, which
+                               has processes waiting */
+  EVENT_SEMAPHORE_BAD_VALUE, /* pid could not create a semaphore with the
+                               negative value arg */
+  EVENT_DEADLOCK_CYCLE,     /* pid closed a cycle of arg waiting processes;
+                               one EVENT_DEADLOCK_WAIT per process follows */
+  EVENT_DEADLOCK_WAIT,      /* pid, in a cycle, waits on semaphore arg */
+  EVENT_DISK_READ_ASYNC,    /* pid issued an asynchronous disk read */
+  EVENT_DISK_QUEUE_FULL,    /* pid could not, arg reads being outstanding */
+  EVENT_DISK_WAIT,          /* pid waits for arg finished disk reads */
+  EVENT_DISK_REAP,          /* pid reaped arg finished disk reads */
+  EVENT_SET_NICE,           /* pid set its nice value to arg */
+  EVENT_SHARE,              /* exiting pid got arg >> 16 and asked for
+                               arg & 0xFFFF hundredths of a percent of
+                               the CPU */
+  EVENT_SLEEP,              /* pid sleeps for arg ms */
+  EVENT_WAKE,               /* pid's sleep ended */
+  EVENT_SEMAPHORE_TIMEOUT,  /* pid gave up waiting on semaphore arg */
+  EVENT_GROUP_CREATE,       /* pid created group arg (NO_GROUP if it is
+                               too deep) */
+  EVENT_GROUP_JOIN,         /* pid joined group arg */
+  EVENT_GROUP_INVALID,      /* pid used group arg, which does not exist */
+  EVENT_THROTTLE,           /* pid's group arg used up its quota */
+  EVENT_UNTHROTTLE,         /* pid's group got a new quota */
+  EVENT_REALTIME_ADMIT,     /* pid became real-time; the class uses arg
+                               hundredths of a percent of a CPU */
+  EVENT_REALTIME_REJECT,    /* pid could not, the class being full */
+  EVENT_REALTIME_INVALID,   /* pid could not, asking for a runtime above
+                               its deadline or a deadline above its period */
+  EVENT_REALTIME_LEAVE,     /* pid is no longer real-time */
+  EVENT_DEADLINE_MISS,      /* pid's job ended arg ms after its deadline */
+  EVENT_BUDGET_THROTTLE,    /* pid's real-time job used up its budget and
+                               waits for a new one until time arg */
+  EVENT_RWLOCK_READ,        /* pid locks rwlock arg for reading */
+  EVENT_RWLOCK_WRITE,       /* pid locks rwlock arg for writing */
+  EVENT_RWLOCK_UNLOCK,      /* pid unlocks rwlock arg */
+  EVENT_RWLOCK_GRANT,       /* waiting pid got rwlock arg */
+  EVENT_RWLOCK_INVALID,     /* pid used rwlock arg, which does not exist
+                               or which it does not hold */
+  EVENT_CONDVAR_WAIT,       /* pid waits on condition variable arg */
+  EVENT_CONDVAR_SIGNAL,     /* pid signals condition variable arg */
+  EVENT_CONDVAR_BROADCAST,  /* pid wakes everyone waiting on condition
+                               variable arg */
+  EVENT_CONDVAR_WAKE,       /* pid's wait on condition variable arg ended */
+  EVENT_CONDVAR_INVALID,    /* pid used condition variable arg, which does
+                               not exist */
+  EVENT_BATCH,              /* pid issued a batch of arg operations */
+  NUMBER_OF_EVENT_TYPES
+} EVENT_TYPE;
+
+typedef struct {
+  CLOCK_TIME time;
+  unsigned short type;  /* an EVENT_TYPE */
+  unsigned short cpu;
+  PID_type pid;
+  int arg;
+} EVENT_RECORD;
+
+/* The ring buffer belongs to the thread running the kernel, which puts
+   records in and, whenever the buffer fills up and when the run ends,
+   drains them to the log's file in one write. */
+
+#define EVENT_LOG_CAPACITY 4096  /* records; a power of 2 */
+
+typedef struct {
+  EVENT_RECORD records[EVENT_LOG_CAPACITY];
+
+  // Free-running counts of records put in and taken out
+
+  unsigned int head;
+  unsigned int tail;
+
+  FILE *file;
+} EVENT_LOG;
+
+// Sets up an empty log whose records are written to file (after the magic
+// number, which is written here)
+
+void event_log_init(EVENT_LOG *log, FILE *file);
+
+// Adds a record, draining the buffer first if it is full
+
+void event_log_put(EVENT_LOG *log, const EVENT_RECORD *record);
+
+// Writes every record in the buffer to the log's file and returns how
+// many there were
+
+int event_log_drain(EVENT_LOG *log);
+
+// Prints a record as the kernel's text message
+
+void event_format(FILE *out, const EVENT_RECORD *record);
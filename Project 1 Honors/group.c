@@ -0,0 +1,130 @@
+#include <stdlib.h>
+
+#include "hardware.h"
+#include "group.h"
+
+void group_table_init(GROUP_TABLE *table, int period_length)
+{
+  table->groups = NULL;
+  table->count = 0;
+  table->capacity = 0;
+  table->period_length = period_length;
+  group_create(table, NO_GROUP, GROUP_WEIGHT, 0);
+}
+
+void group_table_free(GROUP_TABLE *table)
+{
+  free(table->groups);
+  table->groups = NULL;
+  table->count = 0;
+  table->capacity = 0;
+}
+
+GROUP *group_get(GROUP_TABLE *table, int id)
+{
+  if ((unsigned int) id >= (unsigned int) table->count)
+    return NULL;
+  return &table->groups[id];
+}
+
+int group_create(GROUP_TABLE *table, int parent, int weight, int quota)
+{
+  GROUP *group;
+
+  if (table->count == table->capacity)
+  {
+    table->capacity = table->capacity ? 2 * table->capacity : 16;
+    table->groups = (GROUP *) realloc(table->groups,
+      table->capacity * sizeof(GROUP));
+  }
+
+  group = &table->groups[table->count];
+  group->parent = parent;
+  group->depth = parent == NO_GROUP ? 0 : table->groups[parent].depth + 1;
+  group->weight = weight;
+  group->quota = quota;
+  group->runnable = 0;
+  group->load = 0;
+  group->period = group_period(table);
+  group->usage = 0;
+  group->total_usage = 0;
+  group->throttles = 0;
+  return table->count++;
+}
+
+void group_start(GROUP_TABLE *table, int id)
+{
+  GROUP *group = &table->groups[id];
+
+  // A group that gains its first competing process starts competing in
+  // its parent
+
+  group->load += GROUP_WEIGHT;
+  for (; group->parent != NO_GROUP; group = &table->groups[group->parent])
+    if (!group->runnable++)
+      table->groups[group->parent].load += group->weight;
+  group->runnable++;
+}
+
+void group_stop(GROUP_TABLE *table, int id)
+{
+  GROUP *group = &table->groups[id];
+
+  group->load -= GROUP_WEIGHT;
+  for (; group->parent != NO_GROUP; group = &table->groups[group->parent])
+    if (!--group->runnable)
+      table->groups[group->parent].load -= group->weight;
+  group->runnable--;
+}
+
+int group_weigh(GROUP_TABLE *table, int id, int ran)
+{
+  GROUP *group = &table->groups[id];
+  long long weighed = ran;
+
+  // A process's share of its group is GROUP_WEIGHT / load, and the group's
+  // share of its parent weight / the parent's load; the root group's load
+  // is the same for everyone, so it is left out
+
+  for (; group->parent != NO_GROUP; group = &table->groups[group->parent])
+    weighed = weighed * group->load / group->weight;
+  return (int) weighed;
+}
+
+void group_charge(GROUP_TABLE *table, int id, int ran)
+{
+  int period = group_period(table);
+  GROUP *group;
+
+  for (; id != NO_GROUP; id = group->parent)
+  {
+    group = &table->groups[id];
+    if (group->period != period)
+    {
+      group->period = period;
+      group->usage = 0;
+    }
+    if (group->quota && group->usage < group->quota &&
+      group->usage + ran >= group->quota)
+      group->throttles++;
+    group->usage += ran;
+    group->total_usage += ran;
+  }
+}
+
+int group_remaining(GROUP_TABLE *table, int id, int limit)
+{
+  int period = group_period(table), left;
+  GROUP *group;
+
+  for (; id != NO_GROUP; id = group->parent)
+  {
+    group = &table->groups[id];
+    if (!group->quota)
+      continue;
+    left = group->quota - (group->period == period ? group->usage : 0);
+    if (left < limit)
+      limit = left;
+  }
+  return limit;
+}
@@ -0,0 +1,129 @@
+
+/* Process groups, which share the CPU as a whole rather than process by
+   process (see GROUP_OP in kernel.h).
+
+   Groups form a tree under the root group, ROOT_GROUP, which every
+   process starts in; a forked process joins its parent's group, and a
+   new group is made a child of its creator's group. Groups are never
+   destroyed, and a group ID is an index into the table.
+
+   Weight: under the policies that weigh processes (CFS and stride), a
+   group's weight is its share of its parent against the parent's own
+   processes (GROUP_WEIGHT each) and its other child groups that have a
+   READY or RUNNING process. A process is charged for its CPU time as if
+   its weight had been scaled down by its group's share of its parent, and
+   that one's of its parent, and so on, which comes to the same as
+   scheduling the tree level by level. The groups keep the weights they
+   compete with up to date as processes start and stop competing, so this
+   costs the depth of the process's group in the tree.
+
+   Quota: a group may use at most its quota of CPU time in every period of
+   the kernel's group period (see kernel_set_group_period()), counting
+   the time used by the groups below it. Periods are numbered from time 0
+   and a group's usage is only brought up to date when it is charged, so a
+   group is throttled as soon as it has used up its quota in the current
+   period, and every group is unthrottled at once when the next period
+   starts, both in constant time. */
+
+#define ROOT_GROUP 0
+#define NO_GROUP -1
+
+// The weight of a process, and of a group by default; weights are between
+// 1 and MAX_GROUP_WEIGHT
+
+#define GROUP_WEIGHT 1024
+#define MAX_GROUP_WEIGHT 65536
+
+// The default group period, in ms
+
+#define GROUP_PERIOD 100
+
+// Deepest a group can be below the root group
+
+#define MAX_GROUP_DEPTH 16
+
+// Operations of the GROUP_OP trap, in R3
+
+#define GROUP_CREATE 0  /* weight in R2 (0 for the default), quota in R4 (0
+                           for none); the new ID is put in R2 */
+#define GROUP_JOIN 1    /* ID in R2 */
+
+typedef struct {
+  int parent;  // NO_GROUP for the root group
+  int depth;
+  int weight;
+  int quota;   // ms per period, 0 for none
+
+  // READY or RUNNING processes in the group and the groups below it, and
+  // the weight competing directly under the group: GROUP_WEIGHT for each
+  // of its own such processes and the weight of each child group with one
+
+  int runnable;
+  long long load;
+
+  // CPU time used in period number period, and in total; how many times
+  // the group has been throttled
+
+  int period;
+  int usage;
+  long long total_usage;
+  int throttles;
+} GROUP;
+
+typedef struct {
+  GROUP *groups;
+  int count;
+  int capacity;
+  int period_length;
+} GROUP_TABLE;
+
+// Sets up a table holding only the root group, with the given period
+
+void group_table_init(GROUP_TABLE *table, int period_length);
+
+// Frees a table's groups
+
+void group_table_free(GROUP_TABLE *table);
+
+// Returns a group, or NULL if the ID is out of range
+
+GROUP *group_get(GROUP_TABLE *table, int id);
+
+// Creates a group below parent (its depth must be below MAX_GROUP_DEPTH)
+// and returns its ID
+
+int group_create(GROUP_TABLE *table, int parent, int weight, int quota);
+
+// A process of a group starts or stops competing for the CPU
+
+void group_start(GROUP_TABLE *table, int id);
+void group_stop(GROUP_TABLE *table, int id);
+
+// Returns how many ms of CPU time, scaled up from ran by the group's and
+// its ancestors' shares, to charge a process of a group for under a
+// policy that weighs processes
+
+int group_weigh(GROUP_TABLE *table, int id, int ran);
+
+// Charges a group and the groups above it for ran ms of CPU time used now
+
+void group_charge(GROUP_TABLE *table, int id, int ran);
+
+// Returns how many ms the group, or one above it, can still use in the
+// current period before it is throttled (at most limit)
+
+int group_remaining(GROUP_TABLE *table, int id, int limit);
+
+// Returns the number of the current period
+
+static inline int group_period(GROUP_TABLE *table)
+{
+  return clock / table->period_length;
+}
+
+// Returns TRUE if the group, or one above it, is throttled
+
+static inline BOOL group_throttled(GROUP_TABLE *table, int id)
+{
+  return group_remaining(table, id, 1) <= 0;
+}
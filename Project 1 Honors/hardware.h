@@ -3,6 +3,16 @@ typedef int BOOL;
 #define TRUE 1
 #define FALSE 0
 
+/* A simulator that runs several machines at once, one per thread, is built
+   with -DTHREAD_LOCAL_HARDWARE so that the registers, the clock and the
+   interrupt table below belong to the calling thread's machine. */
+
+#ifdef THREAD_LOCAL_HARDWARE
+#define HARDWARE_REGISTER __thread
+#else
+#define HARDWARE_REGISTER
+#endif
+
 /* A PID is just an int */
 
 typedef int PID_type;
@@ -10,7 +20,7 @@ typedef int PID_type;
 /* This is the variable (e.g. a special register) containing
    the PID of the process that is currently running */
 
-extern PID_type current_pid;
+extern HARDWARE_REGISTER PID_type current_pid;
 
 
 /* This defines the maximum number of processes that can
@@ -35,7 +45,7 @@ typedef unsigned int CLOCK_TIME; /* time in ms */
    to store information about trap or interrupt
    that has occurred (see below). */
 
-extern int R1, R2, R3, R4; /* registers for holding
+extern HARDWARE_REGISTER int R1, R2, R3, R4; /* registers for holding
                               trap or interrupt info */
 
 
@@ -43,7 +53,7 @@ extern int R1, R2, R3, R4; /* registers for holding
    Only the hardware can change the value of it, do
    not write to it! */
 
-extern CLOCK_TIME clock;  /* system clock in ms */
+extern HARDWARE_REGISTER CLOCK_TIME clock;  /* system clock in ms */
 
 /* A clock interrupt is generated by the hardware every 10 ms.
    Note that this may be shorter than the quantum given to
@@ -114,4 +124,4 @@ extern CLOCK_TIME clock;  /* system clock in ms */
 
 typedef void (*FN_TYPE)();
 
-extern FN_TYPE INTERRUPT_TABLE[];
+extern HARDWARE_REGISTER FN_TYPE INTERRUPT_TABLE[];
@@ -0,0 +1,116 @@
+#include <stdio.h>
+
+#include "histogram.h"
+
+static int bucket_of(unsigned int value)
+{
+  int shift;
+
+  if (value < HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  // The top HISTOGRAM_SUB_BITS + 1 bits of the value pick the bucket
+
+  shift = 31 - __builtin_clz(value) - HISTOGRAM_SUB_BITS;
+  return ((shift + 1) << HISTOGRAM_SUB_BITS) +
+    (int) (value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+// The largest value that falls in a bucket
+
+static int bucket_top(int bucket)
+{
+  int shift;
+
+  if (bucket < HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+  return (int) ((((unsigned int) (bucket & (HISTOGRAM_SUB_BUCKETS - 1)) +
+    HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1);
+}
+
+void histogram_init(HISTOGRAM *histogram)
+{
+  int i;
+
+  histogram->count = 0;
+  histogram->sum = 0;
+  histogram->min = 0;
+  histogram->max = 0;
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    histogram->buckets[i] = 0;
+}
+
+void histogram_record(HISTOGRAM *histogram, int value)
+{
+  if (value < 0)
+    value = 0;
+
+  if (!histogram->count || value < histogram->min)
+    histogram->min = value;
+  if (!histogram->count || value > histogram->max)
+    histogram->max = value;
+  histogram->count++;
+  histogram->sum += value;
+  histogram->buckets[bucket_of(value)]++;
+}
+
+int histogram_percentile(const HISTOGRAM *histogram, double fraction)
+{
+  unsigned long rank, seen = 0;
+  int i;
+
+  if (!histogram->count)
+    return 0;
+
+  // The rank (counting from 1) of the value wanted
+
+  rank = (unsigned long) (fraction * histogram->count + 0.5);
+  if (rank < 1)
+    rank = 1;
+  if (rank > histogram->count)
+    rank = histogram->count;
+
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    seen += histogram->buckets[i];
+    if (seen >= rank)
+      break;
+  }
+
+  // The bucket's top can overshoot what was actually recorded
+
+  return bucket_top(i) < histogram->max ? bucket_top(i) : histogram->max;
+}
+
+void histogram_write_csv_header(FILE *out)
+{
+  fprintf(out, "metric,count,sum,min,mean,p50,p90,p99,p999,max\n");
+}
+
+void histogram_write_csv(FILE *out, const char *name,
+  const HISTOGRAM *histogram)
+{
+  fprintf(out, "%s,%lu,%lld,%d,%.2f,%d,%d,%d,%d,%d\n", name,
+    histogram->count, histogram->sum, histogram->min,
+    histogram->count ? (double) histogram->sum / histogram->count : 0.0,
+    histogram_percentile(histogram, 0.5),
+    histogram_percentile(histogram, 0.9),
+    histogram_percentile(histogram, 0.99),
+    histogram_percentile(histogram, 0.999), histogram->max);
+}
+
+void histogram_write_json(FILE *out, const char *name,
+  const HISTOGRAM *histogram)
+{
+  fprintf(out, "\"%s\": {\"count\": %lu, \"sum\": %lld, \"min\": %d, "
+    "\"mean\": %.2f, \"p50\": %d, \"p90\": %d, \"p99\": %d, "
+    "\"p999\": %d, \"max\": %d}", name,
+    histogram->count, histogram->sum, histogram->min,
+    histogram->count ? (double) histogram->sum / histogram->count : 0.0,
+    histogram_percentile(histogram, 0.5),
+    histogram_percentile(histogram, 0.9),
+    histogram_percentile(histogram, 0.99),
+    histogram_percentile(histogram, 0.999), histogram->max);
+}
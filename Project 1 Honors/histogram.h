@@ -0,0 +1,45 @@
+
+/* HDR-style histograms of non-negative times (in ms). Values below
+   2^HISTOGRAM_SUB_BITS each have their own bucket; above that, every
+   power of 2 is split into 2^HISTOGRAM_SUB_BITS equal buckets, so a
+   value is only ever rounded by less than 1 part in 2^HISTOGRAM_SUB_BITS
+   (about 3%) whatever its size. Recording a value is a count leading
+   zeros, a shift and an increment, cheap enough to do on every dispatch. */
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+// Enough buckets for any non-negative int
+
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+  unsigned long count;
+  long long sum;
+  int min;
+  int max;
+  unsigned int buckets[HISTOGRAM_BUCKETS];
+} HISTOGRAM;
+
+// Empties a histogram
+
+void histogram_init(HISTOGRAM *histogram);
+
+// Adds a value (negative values count as 0)
+
+void histogram_record(HISTOGRAM *histogram, int value);
+
+// Returns the value below or at which the given fraction (0 to 1) of the
+// recorded values lie, to the histogram's precision; 0 if it is empty
+
+int histogram_percentile(const HISTOGRAM *histogram, double fraction);
+
+// Writes a histogram's summary (count, sum, min, mean, median, 90th, 99th
+// and 99.9th percentiles and max) as a CSV line or a JSON member; the CSV
+// header names the columns
+
+void histogram_write_csv_header(FILE *out);
+void histogram_write_csv(FILE *out, const char *name,
+  const HISTOGRAM *histogram);
+void histogram_write_json(FILE *out, const char *name,
+  const HISTOGRAM *histogram);
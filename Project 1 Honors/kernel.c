@@ -1,9 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "hardware.h"
 #include "drivers.h"
 #include "kernel.h"
+#include "process_table.h"
+#include "event_log.h"
+#include "histogram.h"
+#include "semaphore.h"
+#include "disk.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "group.h"
+#include "realtime.h"
+#include "sync.h"
 
 // Everything that should have been in the header file:
 
@@ -11,10 +22,23 @@
 
 void handle_trap();
 
+// Runs the operation selected by R1, for a trap or one of a batch's
+
+void run_operation();
+
+// Invoked when a TRAP is a batch of operations
+
+void handle_batch();
+
 // Invoked when a TRAP is a disk read
 
 void handle_disk_read();
 
+// Invoked when a TRAP is an asynchronous disk read, or a wait for them
+
+void handle_disk_read_async();
+void handle_disk_wait();
+
 // Invoked when a TRAP is a keyboard read
 
 void handle_keyboard();
@@ -31,6 +55,33 @@ void handle_kill();
 
 void handle_semaphore();
 
+// Invoked when a TRAP sets the process's nice value
+
+void handle_set_nice();
+
+// Invoked when a TRAP puts the process to sleep
+
+void handle_sleep();
+
+// Returns the time ms from now, or LAST_TICK_TIME if that is sooner (see
+// kernel.h)
+
+CLOCK_TIME clock_after(int ms);
+
+// Invoked when a TRAP creates or joins a process group
+
+void handle_group();
+
+// Invoked when a TRAP makes the process real-time, or ordinary again
+
+void handle_set_realtime();
+
+// Invoked when a TRAP locks or unlocks a reader-writer lock, or uses a
+// condition variable
+
+void handle_rwlock();
+void handle_condvar();
+
 // Handles a clock interrupt
 
 void handle_clock_interrupt();
@@ -43,59 +94,125 @@ void handle_disk_interrupt();
 
 void handle_keyboard_interrupt();
 
-// Next two methods can be used for both semaphore and process queues
-// Moving declarations here makes it easier
-
-typedef struct PID_queue_elt {
-  struct PID_queue_elt *next;
-  PID_type pid;
-} PID_QUEUE_ELT;
-
-typedef struct {
-  PID_QUEUE_ELT *head;
-  PID_QUEUE_ELT *tail;
-} PID_QUEUE;
-
 // Schedules a process to run now
 
-void schedule(int queue_num);
+void schedule();
+
+// Next two methods are for semaphore queues (see PID_QUEUE in
+// process_table.h); run queues belong to the scheduler (see scheduler.h)
 
 // Put a process at the end of the queue
 
 void enqueue(PID_QUEUE *queue, PID_type pid);
 
-typedef enum { RUNNING, READY, BLOCKED , UNINITIALIZED } PROCESS_STATE;
+// Take the process at the head of a (non-empty) queue
+
+PID_type dequeue(PID_QUEUE *queue);
+
+// Take a process off a queue, wherever it is on it
+
+void unqueue(PID_QUEUE *queue, PID_type pid);
+
+// Mark a process READY and put it on the run queue of the CPU chosen for
+// it by select_cpu()
+
+void make_ready(PID_type pid);
+
+// Charge the running process (and its CPU) for the time since its quantum
+// started, telling the scheduler whether the quantum expired, and restart
+// the quantum
+
+void charge_current(BOOL expired);
+
+// Block the running process (whose wait, for the given reason, has already
+// been set up), tell the scheduler whether it gave up the CPU early and
+// schedule another process
 
+void block_current(BLOCK_REASON reason);
 
-typedef struct process_table_entry {
-  PROCESS_STATE state;
-  int total_CPU_time_used;
-  int priority;
-} PROCESS_TABLE_ENTRY;
+// Wake a process whose timer has expired: end its sleep, or its wait on a
+// semaphore
 
-// Designated initializer for array semaphores (just in case) so random
-// values aren't put there
+void wake_timer(PID_type pid);
 
-PROCESS_TABLE_ENTRY process_table[MAX_NUMBER_OF_PROCESSES] =
-  {[0 ... MAX_NUMBER_OF_PROCESSES-1] = { UNINITIALIZED, 0, 0}};
+// Throttle a READY or RUNNING process whose group has used up its quota,
+// or make the processes throttled in an earlier period ready again
+// (returning TRUE if there were any)
 
-// Pointer to the current ready queue entry
+void throttle(PID_type pid);
+BOOL unthrottle();
 
-PID_QUEUE_ELT *ready_queue_entry;
+// Throttle a preempted real-time process whose job used up its budget
+// until its deadline, when it gets a new one (see realtime.h)
 
-// Pointer to the ready queue array
+void throttle_realtime(PID_type pid);
 
-PID_QUEUE ready_queues[5] = {[0 ... 4] = {NULL, NULL}};
+// Returns TRUE if a READY real-time process should run before the running
+// one
 
-// Semaphore struct
+BOOL preempted_by_realtime();
+
+// Ends the running real-time process's job, recording whether it was in
+// time
+
+void end_realtime_job(PID_type pid);
+
+// Release the running process's hold on a reader-writer lock, making the
+// processes it is handed to ready
+
+void release_rwlock(int id);
+
+// Release every reader-writer lock the running process holds (when it
+// exits)
+
+void release_rwlocks();
+
+// Take a process woken from condition variable id back to the lock it
+// gave up: ready if it gets it, otherwise still blocked, now on the lock
+
+void wake_condvar(PID_type pid, int id);
+
+/* Number of simulated CPUs. It can be overridden at compile time, e.g.
+   -DNUMBER_OF_CPUS=4.
+
+   The CPUs run in parallel against the one clock, each with its own
+   running process and quantum. The hardware's registers belong to one
+   CPU at a time: a hardware model that runs several CPUs selects one with
+   kernel_select_cpu(), which loads the CPU's running process into
+   current_pid, before it delivers a trap or an interrupt there (see
+   kernel.h). The supplied hardware only runs one CPU, so the stand-alone
+   system is built with one. */
+
+#ifndef NUMBER_OF_CPUS
+#define NUMBER_OF_CPUS 1
+#endif
+
+#if NUMBER_OF_CPUS < 1 || NUMBER_OF_CPUS > 256
+#error "NUMBER_OF_CPUS must be between 1 and 256"
+#endif
 
 typedef struct {
-  PID_QUEUE *ready_queue;
-  int value;
-} SEMAPHORE;
+  PID_type current_pid;  // IDLE_PROCESS when the CPU has nothing to run
+  RUN_QUEUE run_queue;
+
+  // When the running process's quantum started and how long the scheduler
+  // lets it run
+
+  int quantum_start_time;
+  int time_slice;
+
+  // Statistics reported at shutdown
+
+  int busy_time;
+  int migrations;  // processes that ran here after last running elsewhere
+  int steals;      // processes taken from another CPU's run queue
+  int switches;    // dispatches of another process than the last one run
+  int starved;     // dispatches after waiting STARVATION_TIME or more
+  PID_type last_pid;
+} CPU;
 
 /* This constant defines the number of semaphores that your code should
-   support */
+   support, unless told otherwise (see kernel_set_semaphores()) */
 
 #define NUMBER_OF_SEMAPHORES 16
 
@@ -104,387 +221,2236 @@ typedef struct {
 
 #define INITIAL_SEMAPHORE_VALUE 1
 
-// Designated initializer for array semaphores (just in case) so random
-// values aren't put there
+/* The number of reader-writer locks and of condition variables (see
+   sync.h) */
 
-SEMAPHORE semaphores[NUMBER_OF_SEMAPHORES] = {[0 ... NUMBER_OF_SEMAPHORES-1]
-    = { NULL, 1}};
+#define NUMBER_OF_RWLOCKS 16
+#define NUMBER_OF_CONDVARS 16
 
-/* A quantum is 40 ms */
+#if NUMBER_OF_RWLOCKS > MAX_RWLOCKS
+#error "NUMBER_OF_RWLOCKS must be at most MAX_RWLOCKS"
+#endif
 
-#define QUANTUM 40
+// Number of processes a CPU is running or has ready to run
 
+int cpu_load(CPU *cpu);
 
-/* This variable can be used to store the current value of the clock
-   when a process starts its quantum. Later on, when an interrupt
-   (of any kind) occurs, if the difference between the current time
-   and the quantum start time is greater or equal to QUANTUM (40),
-   then the current process has used up its quantum. */
+// Returns the CPU (other than an empty one) with the most ready processes,
+// or NULL if no CPU has a ready process
 
-int current_quantum_start_time;
+CPU *busiest_cpu();
 
-// Counter to keep track of how many active process there are at the moment
+// Chooses the CPU whose run queue a process that becomes ready goes on
 
-int active_processes;
+CPU *select_cpu(PID_type pid);
 
-// Counter to check for deadlocked system (stores number of current IO blocks)
+// Prints per-CPU utilisation, of the time simulated, and migration counts
+// (with more than one CPU)
 
-int io_processes;
+void print_cpu_stats();
 
-/* This procedure is automatically called when the
-   (simulated) machine boots up */
+// Prints every group's CPU time and throttles (if there are groups)
 
-void initialize_kernel()
-{
-  // Populate interrupt table
+void print_group_stats();
 
-  INTERRUPT_TABLE[TRAP] = handle_trap;
-  INTERRUPT_TABLE[CLOCK_INTERRUPT] = handle_clock_interrupt;
-  INTERRUPT_TABLE[DISK_INTERRUPT] = handle_disk_interrupt;
-  INTERRUPT_TABLE[KEYBOARD_INTERRUPT] =  handle_keyboard_interrupt;
+// Records an event: counts it and, unless the kernel is quiet, prints it or
+// puts it in the binary log
 
-  // Put first process into the process table
+void log_event(EVENT_TYPE type, PID_type pid, int arg);
 
-  process_table[current_pid].state = RUNNING;
+/* Latency and fairness metrics. The per-process ones are the totals of
+   each process, recorded when it exits (processes still alive when the
+   run ends are left out):
 
-  // Initialize current quantum time and counters
+   cpu_time        : CPU time used
+   wait_time       : time spent READY
+   response_time   : time from creation to first running
+   turnaround_time : time from creation to exit
+   blocked_time    : time spent BLOCKED, by what the process waited for
 
-  current_quantum_start_time = clock;
-  active_processes = 1;
-  io_processes = 0;
+   The per-level ones are recorded every time a process is dispatched from
+   or charged at a priority level; together they show how long processes
+   reside at each level:
 
-}
+   level_wait : how long the process was READY before being dispatched
+   level_run  : how long it then ran (until its quantum ended or it
+                blocked or exited)
 
-void handle_trap()
-{
-  // Switch that handles what kind of trap occured
+   The real-time one is recorded at the end of every job (see
+   realtime.h):
 
-  switch (R1)
-  {
-    case DISK_READ:
-      handle_disk_read();
-      break;
-    case DISK_WRITE:
-      disk_write_req(current_pid);
-      printf("Time %d: Process %d issues disk write request\n",
-        clock, current_pid);
-      break;
-    case KEYBOARD_READ:
-      handle_keyboard();
-      break;
-    case FORK_PROGRAM:
-      handle_fork();
-      break;
-    case END_PROGRAM:
-      handle_kill();
-      break;
-    case SEMAPHORE_OP:
-      handle_semaphore();
-  }
-}
+   rt_tardiness : how long after its deadline the job ended (0 if in time)
 
-void handle_disk_read()
-{
-  printf("Time %d: Process %d issues disk read request\n",
-    clock, current_pid);
+   All times are clock times. */
 
-  // Mark the process as blocked in the table
+typedef struct {
+  HISTOGRAM cpu_time;
+  HISTOGRAM wait_time;
+  HISTOGRAM response_time;
+  HISTOGRAM turnaround_time;
+  HISTOGRAM blocked_time[NUMBER_OF_BLOCK_REASONS];
+  HISTOGRAM level_wait[NUMBER_OF_PRIORITY_LEVELS];
+  HISTOGRAM level_run[NUMBER_OF_PRIORITY_LEVELS];
+  HISTOGRAM rt_tardiness;
+} KERNEL_METRICS;
 
-  process_table[current_pid].state = BLOCKED;
+/* Deadlocks among processes waiting on semaphores are found the moment
+   they form, when a process blocks in a DOWN. A process waits on at most
+   one semaphore and a semaphore that is a lock has at most one owner (see
+   semaphore.h), so every process has at most one process it waits for:
+   the owner of its semaphore. A new wait can therefore only close a cycle
+   through the process that starts waiting, and following owners from its
+   semaphore either comes back to it, which is a deadlock, or ends at a
+   process that is not waiting on a lock. The cost is the length of that
+   chain of waiting processes, which for a deadlock is the cycle itself.
 
-  if (clock - current_quantum_start_time < QUANTUM)
-  {
-    if (process_table[current_pid].priority < 4)
-      process_table[current_pid].priority++;
-  }
+   Semaphores that count have no owner, so waits on them never take part
+   in a cycle: a deadlock through them is only found by the whole-system
+   check in schedule().
 
-  // Put request and update all the necessary counters
+   An owner is only the process that took a semaphore last: any process
+   may UP it, so a cycle is not proof of a deadlock while some process
+   outside it can still run. A cycle only ends the run (with
+   KERNEL_DEADLOCK_STOP) when every other process is waiting on a
+   semaphore with no timeout too, which nothing can ever wake. */
 
-  disk_read_req(current_pid, R2);
-  io_processes++;
+// Returns the number of processes in the cycle the running process would
+// close by waiting on semaphore id, or 0 if it would not close one
 
-  process_table[current_pid].total_CPU_time_used +=
-    (clock - current_quantum_start_time);
-  current_quantum_start_time = clock;
+int find_deadlock(int id);
 
-  // Schedule a process (since the current one gets blocked)
+// Reports the cycle closed by the running process waiting on semaphore id
 
-  schedule(4);
-}
+void report_deadlock(int id, int length);
 
-void handle_keyboard()
-{
-  printf("Time %d: Process %d issues keyboard read request\n",
-    clock, current_pid);
+// Returns TRUE if no process outside a cycle closed by the running process
+// can ever UP a semaphore
 
-  // Mark the process as blocked in the table
+BOOL deadlock_is_final(void);
 
-  process_table[current_pid].state = BLOCKED;
+// Records the metrics of an exiting process
 
-  // Put request and update all the necessary counters
+void record_exit_metrics(PID_type pid);
 
-  if (clock - current_quantum_start_time < QUANTUM)
-  {
-    if (process_table[current_pid].priority < 4)
-      process_table[current_pid].priority++;
-  }
+// Start and stop a process's share accounting, when it becomes READY
+// after being created or blocked and when it blocks or exits
 
-  keyboard_read_req(current_pid);
-  io_processes++;
+void start_share(PID_type pid);
+void stop_share(PID_type pid);
 
-  process_table[current_pid].total_CPU_time_used +=
-    (clock - current_quantum_start_time);
-  current_quantum_start_time = clock;
+// Reports the share of the CPU an exiting process got and asked for
 
-  // Schedule a process (since the current one gets blocked)
+void report_share(PID_type pid);
 
-  schedule(4);
-}
+/* The current value of the clock is stored in the CPU's quantum_start_time
+   when a process starts its quantum. Later on, when an interrupt
+   (of any kind) occurs, if the difference between the current time
+   and the quantum start time is greater or equal to the CPU's time_slice
+   (QUANTUM, 40, under MLFQ), then the current process has used up its
+   quantum. */
 
-void handle_fork()
-{
-  printf("Time %d: Creating process entry for pid %d\n", clock, R2);
+#define QUANTUM_USED() (clock - kernel->this_cpu->quantum_start_time)
 
-  // Update process table with the new process; update counters
+/* All of the kernel's state lives in a context, so that a driver can run
+   many simulations in one process, each on its own thread (with the
+   hardware built for it, see THREAD_LOCAL_HARDWARE in hardware.h). The
+   kernel works on the context selected on the calling thread. */
 
-  process_table[R2].state = READY;
-  active_processes++;
+struct kernel_context {
+  PROCESS_TABLE process_table;
 
-  // Put new process to the ready queue.
-  // Malloc the new node (hence passing address)
+  CPU cpus[NUMBER_OF_CPUS];
 
-  enqueue(&ready_queues[process_table[R2].priority], R2);
+  // The CPU currently holding the hardware (whose process is in
+  // current_pid)
 
-}
+  CPU *this_cpu;
 
-void handle_kill()
-{
-  // Update process table and counter
+  // The scheduling policy (see scheduler.h)
 
-  process_table[current_pid].state = UNINITIALIZED;
-  process_table[current_pid].total_CPU_time_used +=
-    (clock - current_quantum_start_time);
-  process_table[current_pid].priority = 0;
-  active_processes--;
+  const SCHED_POLICY *scheduler;
 
-  //STDOUT kill process message (after updating table since total time changes)
-  printf("Time %d: Process %d exits. Total CPU time = %d\n", clock, current_pid,
-    process_table[current_pid].total_CPU_time_used);
+  SEMAPHORE_TABLE semaphores;
 
-  // Start the process on the ready queue
-  current_quantum_start_time = clock;
-  schedule(4);
+  // Reader-writer locks and condition variables
 
-}
+  SYNC_TABLE sync;
 
-void handle_semaphore()
-{
-  // Temporary variable for semaphore (for simplicity)
+  // The disk's request scheduler
 
-  SEMAPHORE *sem = &semaphores[R2];
+  DISK disk;
 
-  if (R3) // UP
-  {
-    printf("Time %d: Process %d issues UP operation on semaphore %d\n", clock,
-      current_pid, R2);
+  // Whether the hardware puts arguments in R3 for every trap (see
+  // kernel_set_full_registers())
 
-    // Check if the semaphore value is 0; check for NULL pointers (nothing in
-    // the queue or it wasn't initialized, which is done by enqueu())
+  BOOL full_registers;
 
-    if (!sem->value && (sem->ready_queue != NULL) &&
-      (sem->ready_queue->head != NULL))
-    {
-      // Get new pid; update the table; put it in the ready queue; rm 1st node
+  // Timers of sleeping processes and of semaphore DOWNs with a timeout
 
-      PID_type pid = sem->ready_queue->head->pid;
-      process_table[pid].state = READY;
-      enqueue(&ready_queues[process_table[pid].priority], pid);
-      sem->ready_queue->head = sem->ready_queue->head->next;
-    }
-    else
-    {
-      sem->value++;
-    }
-  }
-  else // DOWN
-  {
-    printf("Time %d: Process %d issues DOWN operation on semaphore %d\n", clock,
-      current_pid, R2);
+  TIMER_WHEEL timers;
 
-    // Check for non-zero value
+  // The real-time processes, and the EDF heap of the READY ones
 
-    if (sem->value)
-    {
-      sem->value--;
-    }
-    else
-    {
-      // Block the process; init or update the semaphore's ready queue
+  REALTIME_CLASS realtime;
 
-      process_table[current_pid].state = BLOCKED;
+  // Process groups, the processes throttled because a group used up its
+  // quota and the period they were throttled in
 
+  GROUP_TABLE groups;
+  PID_QUEUE throttled;
+  int throttled_period;
 
-      // If a queue is null, then we initialize it
+  // Counter to keep track of how many active process there are at the
+  // moment
 
-      if (sem->ready_queue == NULL)
-      {
-        sem->ready_queue = (PID_QUEUE *) malloc(sizeof(PID_QUEUE));
-        sem->ready_queue->head = NULL;
-        sem->ready_queue->tail = NULL;
-      }
+  int active_processes;
 
-      enqueue(sem->ready_queue, current_pid);
+  // Counter to check for deadlocked system (stores number of current IO
+  // blocks)
 
-      if (clock - current_quantum_start_time < QUANTUM)
-      {
-        if (process_table[current_pid].priority < 4)
-          process_table[current_pid].priority++;
-      }
+  int io_processes;
 
-      // Restart current quantum when a process gets blocked and start a process
+  // Where the kernel's text messages go, how events are logged (see
+  // kernel_set_log()) and, when they are logged in binary, the log
 
-      process_table[current_pid].total_CPU_time_used +=
-        (clock - current_quantum_start_time);
-      current_quantum_start_time = clock;
-      schedule(4);
-    }
-  }
+  FILE *out;
+  KERNEL_LOG_MODE log_mode;
+  EVENT_LOG *log;
+
+  // How many events of each type there have been
+
+  unsigned long event_counts[NUMBER_OF_EVENT_TYPES];
+
+  // The operations of the next BATCH trap, and how many traps and
+  // operations there have been
+
+  BATCH_BUFFER batch;
+  unsigned long traps;
+  unsigned long operations;
+
+  // What to do about deadlock cycles (see kernel_set_deadlock_detection()),
+  // how many processes are blocked on semaphores and how many cycles have
+  // been found
+
+  KERNEL_DEADLOCK_MODE deadlock_mode;
+  int semaphore_waiters;
+  int deadlocks;
+
+  // Share accounting (see PROCESS_COLD): the tickets of the READY and
+  // RUNNING processes, the CPU time used by all processes and its sum
+  // over time of those tickets
+
+  int runnable_tickets;
+  long long busy_total;
+  long long ticket_time;
+
+  // Latency metrics, and where and how to write them when the run ends
+  // (no file if they are not wanted then)
+
+  KERNEL_METRICS metrics;
+  FILE *metrics_file;
+  KERNEL_METRICS_FORMAT metrics_format;
+
+  // How the run ended (KERNEL_RUNNING until it does) and whether to exit()
+  // when it does, as the stand-alone system must since the hardware never
+  // returns control
+
+  KERNEL_RESULT result;
+  BOOL exit_on_halt;
+};
+
+__thread KERNEL_CONTEXT *kernel;
+
+// Records how the run ended and stops the simulation
+
+void kernel_halt(KERNEL_RESULT result);
+
+// Populates the interrupt table
+
+static void install_handlers()
+{
+  INTERRUPT_TABLE[TRAP] = handle_trap;
+  INTERRUPT_TABLE[CLOCK_INTERRUPT] = handle_clock_interrupt;
+  INTERRUPT_TABLE[DISK_INTERRUPT] = handle_disk_interrupt;
+  INTERRUPT_TABLE[KEYBOARD_INTERRUPT] =  handle_keyboard_interrupt;
 }
 
-void handle_clock_interrupt()
+/* This procedure is automatically called when the
+   (simulated) machine boots up */
+
+void initialize_kernel()
 {
-  // Check for idle process and for going over quantum limit
+  // The stand-alone system has no driver to give it a context, so it gets a
+  // default one that exits when the run ends
 
-  if ((current_pid != IDLE_PROCESS) &&
-    ((clock - current_quantum_start_time) >= QUANTUM))
+  if (kernel == NULL)
   {
-    // Update the table
+    kernel_select(kernel_create());
+    kernel->exit_on_halt = TRUE;
+  }
 
-    process_table[current_pid].state = READY;
-    process_table[current_pid].total_CPU_time_used +=
-      (clock - current_quantum_start_time);
-    if (process_table[current_pid].priority > 0)
-      process_table[current_pid].priority--;
+  install_handlers();
 
-    // Reschedule the process
+  // Put first process into the process table; the first CPU runs it
 
-    enqueue(&ready_queues[process_table[current_pid].priority], current_pid);
+  process_create(current_pid);
+  process_hot(current_pid)->state = RUNNING;
+  process_hot(current_pid)->cpu = 0;
+  process_cold(current_pid)->first_run_time = clock;
+  start_share(current_pid);
 
-    // Schedule new process and update the clock
+  kernel->this_cpu = &kernel->cpus[0];
+  kernel->this_cpu->current_pid = current_pid;
 
-    schedule(4);
-    current_quantum_start_time = clock;
+  // Initialize current quantum time and counters
+
+  kernel->this_cpu->quantum_start_time = clock;
+  kernel->this_cpu->time_slice = kernel->scheduler->time_slice(
+    &kernel->this_cpu->run_queue, current_pid);
+  kernel->active_processes = 1;
+  kernel->io_processes = 0;
 
-  }
 }
 
-void handle_disk_interrupt()
+KERNEL_CONTEXT *kernel_create()
 {
-  printf("Time %d: Handled DISK_INTERRUPT for pid %d\n", clock, R1);
+  KERNEL_CONTEXT *context = (KERNEL_CONTEXT *) malloc(sizeof(KERNEL_CONTEXT));
+  MLFQ_CONFIG mlfq;
+  int i, level;
 
-  // Update the table and counters
+  for (level = 0; level < NUMBER_OF_PRIORITY_LEVELS; level++)
+    mlfq.quanta[level] = QUANTUM;
+  mlfq.boost_period = 0;
+  mlfq.allotment = 0;
 
-  process_table[R1].state = READY;
-  io_processes--;
+  process_table_init(&context->process_table);
 
-  // Enqueue the process or start a new one if idle
-
-  enqueue(&ready_queues[process_table[R1].priority], R1);
-
-  if (current_pid == IDLE_PROCESS)
+  context->scheduler = &mlfq_policy;
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+  {
+    mlfq_policy.init(&context->cpus[i].run_queue);
+    context->cpus[i].run_queue.ready_count = 0;
+    context->cpus[i].current_pid = IDLE_PROCESS;
+    context->cpus[i].quantum_start_time = 0;
+    context->cpus[i].time_slice = QUANTUM;
+    context->cpus[i].busy_time = 0;
+    context->cpus[i].migrations = 0;
+    context->cpus[i].steals = 0;
+    context->cpus[i].switches = 0;
+    context->cpus[i].starved = 0;
+    context->cpus[i].last_pid = IDLE_PROCESS;
+    context->cpus[i].run_queue.mlfq.config = mlfq;
+  }
+  context->this_cpu = &context->cpus[0];
+
+  semaphore_table_init(&context->semaphores, NUMBER_OF_SEMAPHORES,
+    NUMBER_OF_SEMAPHORES, INITIAL_SEMAPHORE_VALUE);
+  sync_table_init(&context->sync, NUMBER_OF_RWLOCKS, NUMBER_OF_CONDVARS,
+    RWLOCK_WRITER_PREFERRED);
+  disk_init(&context->disk, DISK_PASSTHROUGH);
+  context->full_registers = FALSE;
+  timer_init(&context->timers, clock);
+  realtime_init(&context->realtime, NUMBER_OF_CPUS);
+  group_table_init(&context->groups, GROUP_PERIOD);
+  context->throttled.head = NO_PID;
+  context->throttled.tail = NO_PID;
+  context->throttled_period = 0;
+
+  context->active_processes = 0;
+  context->io_processes = 0;
+  context->out = stdout;
+  context->log_mode = KERNEL_LOG_TEXT;
+  context->log = NULL;
+  for (i = 0; i < NUMBER_OF_EVENT_TYPES; i++)
+    context->event_counts[i] = 0;
+  context->batch.done = 0;
+  context->traps = 0;
+  context->operations = 0;
+
+  histogram_init(&context->metrics.cpu_time);
+  histogram_init(&context->metrics.wait_time);
+  histogram_init(&context->metrics.response_time);
+  histogram_init(&context->metrics.turnaround_time);
+  for (i = 0; i < NUMBER_OF_BLOCK_REASONS; i++)
+    histogram_init(&context->metrics.blocked_time[i]);
+  for (level = 0; level < NUMBER_OF_PRIORITY_LEVELS; level++)
   {
-    current_quantum_start_time = clock;
-    schedule(4);
+    histogram_init(&context->metrics.level_wait[level]);
+    histogram_init(&context->metrics.level_run[level]);
   }
+  histogram_init(&context->metrics.rt_tardiness);
+  context->deadlock_mode = KERNEL_DEADLOCK_IGNORE;
+  context->semaphore_waiters = 0;
+  context->deadlocks = 0;
+  context->runnable_tickets = 0;
+  context->busy_total = 0;
+  context->ticket_time = 0;
+  context->metrics_file = NULL;
+  context->metrics_format = KERNEL_METRICS_CSV;
+  context->result = KERNEL_RUNNING;
+  context->exit_on_halt = FALSE;
+  return context;
+}
 
+void kernel_select(KERNEL_CONTEXT *context)
+{
+  kernel = context;
+  process_table = &context->process_table;
 }
 
-void handle_keyboard_interrupt()
+void kernel_set_output(KERNEL_CONTEXT *context, FILE *out)
 {
-  printf("Time %d: Handled KEYBOARD_INTERRUPT for pid %d\n", clock, R1);
+  context->out = out;
+}
 
-  // Update table and counters; enqueue process or start a new one if idle
+void kernel_set_log(KERNEL_CONTEXT *context, KERNEL_LOG_MODE mode, FILE *file)
+{
+  if (context->log != NULL)
+  {
+    event_log_drain(context->log);
+    free(context->log);
+    context->log = NULL;
+  }
 
-  process_table[R1].state = READY;
-  io_processes--;
-  enqueue(&ready_queues[process_table[R1].priority], R1);
-  if (current_pid == IDLE_PROCESS)
+  context->log_mode = mode;
+  if (mode == KERNEL_LOG_TEXT)
+    context->out = file;
+  else if (mode == KERNEL_LOG_BINARY)
   {
-    current_quantum_start_time = clock;
-    schedule(4);
+    context->log = (EVENT_LOG *) malloc(sizeof(EVENT_LOG));
+    event_log_init(context->log, file);
   }
+}
+
+unsigned long kernel_event_count(KERNEL_CONTEXT *context, int type)
+{
+  return context->event_counts[type];
+}
 
+void kernel_set_semaphores(KERNEL_CONTEXT *context, int capacity, int open)
+{
+  semaphore_table_free(&context->semaphores);
+  semaphore_table_init(&context->semaphores, capacity, open,
+    INITIAL_SEMAPHORE_VALUE);
 }
 
-void schedule(queue_num)
+void kernel_set_rwlock_mode(KERNEL_CONTEXT *context, int mode)
 {
-  // Exit if no active processes left
+  context->sync.mode = mode;
+}
 
-  if (!active_processes)
-  {
-    printf("-- No more processes to execute --\n");
-    exit(0);
-  }
+void kernel_set_disk_policy(KERNEL_CONTEXT *context, int policy)
+{
+  disk_free(&context->disk);
+  disk_init(&context->disk, policy);
+}
 
-  // Handle case when the queue is empty
+void kernel_set_group_period(KERNEL_CONTEXT *context, int period)
+{
+  context->groups.period_length = period;
+}
 
-  if (ready_queues[queue_num].head == NULL)
-  {
+void kernel_realtime_stats(KERNEL_CONTEXT *context, int *jobs, int *misses)
+{
+  *jobs = context->realtime.jobs;
+  *misses = context->realtime.misses;
+}
+
+BATCH_BUFFER *kernel_batch(KERNEL_CONTEXT *context)
+{
+  return &context->batch;
+}
 
-    // If no IO pending - deadlocked system
+void kernel_trap_stats(KERNEL_CONTEXT *context, unsigned long *traps,
+  unsigned long *operations)
+{
+  *traps = context->traps;
+  *operations = context->operations;
+}
 
-    if (!queue_num && !io_processes)
-    {
-      printf("DEADLOCKED SYSTEM\n");
-      exit(0);
-    }
+void kernel_disk_stats(KERNEL_CONTEXT *context, int *reads, int *requests)
+{
+  *reads = context->disk.reads;
+  *requests = context->disk.requests;
+}
+
+void kernel_set_full_registers(KERNEL_CONTEXT *context, BOOL full)
+{
+  context->full_registers = full;
+}
+
+// The scheduling policies, indexed by SCHED_POLICY_ID
+
+static const SCHED_POLICY *sched_policies[NUMBER_OF_SCHED_POLICIES] = {
+  &mlfq_policy, &cfs_policy, &stride_policy, &lottery_policy };
+
+void kernel_set_scheduler(KERNEL_CONTEXT *context, int policy)
+{
+  KERNEL_CONTEXT *selected = kernel;
+  RUN_QUEUE *run_queue;
+  PID_type *ready;
+  int i, n, count = 0;
+
+  if (context->scheduler == sched_policies[policy])
+    return;
+
+  // Mid-run (after kernel_restore()) the READY processes move to the new
+  // policy's run queue of the same CPU, taken off the old one in the order
+  // it would have run them. Policies reach the process table through the
+  // selected context, so select this one while they do.
 
-    if (queue_num)
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+    count += context->cpus[i].run_queue.ready_count;
+  ready = (PID_type *) malloc((count + 1) * sizeof(PID_type));
+  kernel_select(context);
+
+  for (count = 0, i = 0; i < NUMBER_OF_CPUS; i++)
+  {
+    run_queue = &context->cpus[i].run_queue;
+    for (n = 0; n < run_queue->ready_count; n++)
     {
-      schedule(queue_num-1);
+      ready[count] = context->scheduler->pick_next(run_queue);
+      context->scheduler->dequeue(run_queue, ready[count++]);
     }
-    else
-    {
-      // If IO present - process idle; update pid
+    context->scheduler->destroy(run_queue);
+  }
 
-      printf("Time %d: Processor is idle\n", clock);
-      current_pid = IDLE_PROCESS;
+  context->scheduler = sched_policies[policy];
+  for (count = 0, i = 0; i < NUMBER_OF_CPUS; i++)
+  {
+    run_queue = &context->cpus[i].run_queue;
+    context->scheduler->init(run_queue);
+    for (n = 0; n < run_queue->ready_count; n++, count++)
+    {
+      context->scheduler->on_wake(run_queue, ready[count]);
+      context->scheduler->enqueue(run_queue, ready[count]);
     }
   }
-  else
+
+  free(ready);
+  kernel = selected;
+  process_table = selected != NULL ? &selected->process_table : NULL;
+}
+
+void kernel_set_mlfq(KERNEL_CONTEXT *context, const int *quanta,
+  int boost_period, int allotment)
+{
+  MLFQ_CONFIG *config;
+  int i, level;
+
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
   {
-    // Clear the queue of heading blocked processes (i.e. IO'd). Recursive
+    config = &context->cpus[i].run_queue.mlfq.config;
+    for (level = 0; level < NUMBER_OF_PRIORITY_LEVELS; level++)
+      config->quanta[level] = quanta == NULL ? QUANTUM : quanta[level];
+    config->boost_period = boost_period;
+    config->allotment = allotment;
+  }
+}
 
-    if (process_table[ready_queues[queue_num].head->pid].state == BLOCKED)
-    {
-      ready_queues[queue_num].head = ready_queues[queue_num].head->next;
-      schedule(queue_num);
-    }
-    else
-    {
-      // Update the table and the queue; run a process
-      current_pid = ready_queues[queue_num].head->pid;
-      process_table[current_pid].state = RUNNING;
-      ready_queues[queue_num].head = ready_queues[queue_num].head->next;
-      printf("Time %d: Process %d runs\n", clock, current_pid);
-    }
+void kernel_sched_stats(KERNEL_CONTEXT *context, int *switches, int *starved)
+{
+  int i;
+
+  *switches = 0;
+  *starved = 0;
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+  {
+    *switches += context->cpus[i].switches;
+    *starved += context->cpus[i].starved;
   }
 }
 
-void enqueue(PID_QUEUE *queue, PID_type pid)
+void kernel_set_deadlock_detection(KERNEL_CONTEXT *context,
+  KERNEL_DEADLOCK_MODE mode)
 {
+  context->deadlock_mode = mode;
+}
+
+int kernel_deadlocks(KERNEL_CONTEXT *context)
+{
+  return context->deadlocks;
+}
 
-  // Init a node
+void kernel_set_metrics(KERNEL_CONTEXT *context,
+  KERNEL_METRICS_FORMAT format, FILE *file)
+{
+  context->metrics_format = format;
+  context->metrics_file = file;
+}
 
-  PID_QUEUE_ELT *new_ready_queue_element = (PID_QUEUE_ELT *)
-    malloc(sizeof(PID_QUEUE_ELT));
-  new_ready_queue_element->next = NULL;
-  new_ready_queue_element->pid = pid;
+// Writes one histogram of kernel_write_metrics(); written counts how many
+// have been written before it
+
+static void write_metric(FILE *out, KERNEL_METRICS_FORMAT format,
+  const char *name, const HISTOGRAM *histogram, int *written)
+{
+  if (format == KERNEL_METRICS_CSV)
+    histogram_write_csv(out, name, histogram);
+  else
+  {
+    fprintf(out, *written ? ",\n  " : "\n  ");
+    histogram_write_json(out, name, histogram);
+  }
+  (*written)++;
+}
 
-  // Add a node to tail (and head if it's empty, i.e. just got initialized)
-  if (queue->head == NULL)
-    queue->head = new_ready_queue_element;
-  if (queue->tail != NULL)
-    queue->tail->next = new_ready_queue_element;
-  queue->tail = new_ready_queue_element;
+void kernel_write_metrics(KERNEL_CONTEXT *context,
+  KERNEL_METRICS_FORMAT format, FILE *out)
+{
+  static const char *block_names[NUMBER_OF_BLOCK_REASONS] = {
+    "blocked_disk", "blocked_keyboard", "blocked_semaphore",
+    "blocked_timer", "blocked_quota", "blocked_rwlock", "blocked_condvar" };
+  KERNEL_METRICS *metrics = &context->metrics;
+  char name[32];
+  int written = 0, i;
+
+  if (format == KERNEL_METRICS_CSV)
+    histogram_write_csv_header(out);
+  else
+    fprintf(out, "{");
+
+  write_metric(out, format, "cpu_time", &metrics->cpu_time, &written);
+  write_metric(out, format, "wait_time", &metrics->wait_time, &written);
+  write_metric(out, format, "response_time", &metrics->response_time,
+    &written);
+  write_metric(out, format, "turnaround_time", &metrics->turnaround_time,
+    &written);
+  for (i = 0; i < NUMBER_OF_BLOCK_REASONS; i++)
+    write_metric(out, format, block_names[i], &metrics->blocked_time[i],
+      &written);
+  for (i = 0; i < NUMBER_OF_PRIORITY_LEVELS; i++)
+  {
+    sprintf(name, "level_%d_wait", i);
+    write_metric(out, format, name, &metrics->level_wait[i], &written);
+    sprintf(name, "level_%d_run", i);
+    write_metric(out, format, name, &metrics->level_run[i], &written);
+  }
+  write_metric(out, format, "rt_tardiness", &metrics->rt_tardiness,
+    &written);
+
+  if (format == KERNEL_METRICS_JSON)
+    fprintf(out, "\n}\n");
+}
+
+KERNEL_RESULT kernel_result(KERNEL_CONTEXT *context)
+{
+  return context->result;
+}
+
+void kernel_destroy(KERNEL_CONTEXT *context)
+{
+  int i;
+
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+    context->scheduler->destroy(&context->cpus[i].run_queue);
+  if (context->log != NULL)
+  {
+    event_log_drain(context->log);
+    free(context->log);
+  }
+  process_table_free(&context->process_table);
+  semaphore_table_free(&context->semaphores);
+  sync_table_free(&context->sync);
+  disk_free(&context->disk);
+  group_table_free(&context->groups);
+  realtime_free(&context->realtime);
+  if (kernel == context)
+  {
+    kernel = NULL;
+    process_table = NULL;
+  }
+  free(context);
+}
+
+/* A snapshot is a SNAPSHOT_HEADER, which identifies the kernel's build,
+   the context as it is in memory, then what its pointers point to: the
+   process table's directory and pages, the semaphores, the reader-writer
+   locks and condition variables, the disk's request pool, the groups, the
+   real-time heap and the stride and lottery heaps. The pointers
+   themselves are replaced when the snapshot is restored. */
+
+#define SNAPSHOT_MAGIC "KSNAP1"
+
+typedef struct {
+  char magic[8];
+  int context_size;
+  int page_size;
+  int cpus;
+  int levels;
+  int this_cpu;   // index of the CPU holding the hardware
+  int scheduler;  // a SCHED_POLICY_ID
+} SNAPSHOT_HEADER;
+
+// Write and read size bytes of snapshot; return FALSE if they could not
+// all be
+
+static BOOL write_data(FILE *file, const void *data, size_t size)
+{
+  return fwrite(data, 1, size, file) == size;
+}
+
+static BOOL read_data(FILE *file, void *data, size_t size)
+{
+  return fread(data, 1, size, file) == size;
+}
+
+// Reads count elements of a snapshot into a new array with room for
+// capacity, put in *array even if they could not all be read
+
+static BOOL read_array(FILE *file, void **array, size_t size, int count,
+  int capacity)
+{
+  *array = capacity > 0 ? malloc(capacity * size) : NULL;
+  return count >= 0 && count <= capacity &&
+    read_data(file, *array, count * size);
+}
+
+// Returns TRUE if a context's run queues have stride or lottery heaps
+// (those of other policies are not even initialised)
+
+static BOOL has_heaps(KERNEL_CONTEXT *context)
+{
+  return context->scheduler == &stride_policy ||
+    context->scheduler == &lottery_policy;
+}
+
+// Returns TRUE if a context's policy weighs processes by the CPU time they
+// are charged (and so can weigh their groups)
+
+static BOOL weighs_groups(KERNEL_CONTEXT *context)
+{
+  return context->scheduler == &cfs_policy ||
+    context->scheduler == &stride_policy;
+}
+
+static BOOL save_process_table(PROCESS_TABLE *table, FILE *file)
+{
+  unsigned char present;
+  int i;
+
+  if (!write_data(file, table->empty_slots, table->page_count * sizeof(int))
+    || !write_data(file, table->empty_slot_listed, table->page_count))
+    return FALSE;
+
+  // Every directory slot is a byte telling whether it has a page, then the
+  // page if it does
+
+  for (i = 0; i < table->page_count; i++)
+  {
+    present = table->pages[i] != NULL;
+    if (!write_data(file, &present, 1) || (present &&
+      !write_data(file, table->pages[i], sizeof(PROCESS_TABLE_PAGE))))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+// Reads what save_process_table() wrote into a table read along with the
+// context (its arrays NULL). Whatever it read is in the table, to be freed,
+// even if it fails.
+
+static BOOL restore_process_table(PROCESS_TABLE *table, FILE *file)
+{
+  unsigned char present;
+  BOOL ok;
+  int i;
+
+  table->pages = (PROCESS_TABLE_PAGE **) calloc(table->page_count + 1,
+    sizeof(PROCESS_TABLE_PAGE *));
+  ok = read_array(file, (void **) &table->empty_slots, sizeof(int),
+    table->page_count, table->page_count) &&
+    read_array(file, (void **) &table->empty_slot_listed, 1,
+    table->page_count, table->page_count);
+  for (i = 0; ok && i < table->page_count; i++)
+  {
+    ok = read_data(file, &present, 1);
+    if (ok && present)
+    {
+      table->pages[i] = (PROCESS_TABLE_PAGE *)
+        malloc(sizeof(PROCESS_TABLE_PAGE));
+      ok = read_data(file, table->pages[i], sizeof(PROCESS_TABLE_PAGE));
+    }
+  }
+  return ok;
+}
+
+BOOL kernel_save(KERNEL_CONTEXT *context, FILE *file)
+{
+  SNAPSHOT_HEADER header;
+  STRIDE_QUEUE *stride;
+  int i;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.context_size = sizeof(KERNEL_CONTEXT);
+  header.page_size = sizeof(PROCESS_TABLE_PAGE);
+  header.cpus = NUMBER_OF_CPUS;
+  header.levels = NUMBER_OF_PRIORITY_LEVELS;
+  header.this_cpu = context->this_cpu - context->cpus;
+  while (sched_policies[header.scheduler] != context->scheduler)
+    header.scheduler++;
+
+  if (!write_data(file, &header, sizeof(header)) ||
+    !write_data(file, context, sizeof(KERNEL_CONTEXT)) ||
+    !save_process_table(&context->process_table, file) ||
+    !write_data(file, context->semaphores.semaphores,
+    context->semaphores.capacity * sizeof(SEMAPHORE)) ||
+    !write_data(file, context->sync.rwlocks,
+    context->sync.rwlock_count * sizeof(RWLOCK)) ||
+    !write_data(file, context->sync.condvars,
+    context->sync.condvar_count * sizeof(CONDVAR)) ||
+    !write_data(file, context->disk.pool,
+    context->disk.pool_size * sizeof(DISK_REQUEST)) ||
+    !write_data(file, context->groups.groups,
+    context->groups.count * sizeof(GROUP)) ||
+    !write_data(file, context->realtime.heap,
+    context->realtime.count * sizeof(PID_type)))
+    return FALSE;
+  for (i = 0; has_heaps(context) && i < NUMBER_OF_CPUS; i++)
+  {
+    stride = &context->cpus[i].run_queue.stride;
+    if (!write_data(file, stride->heap, stride->count * sizeof(PID_type)) ||
+      !write_data(file, stride->tickets, stride->count * sizeof(long long)))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL kernel_restore(KERNEL_CONTEXT *context, FILE *file)
+{
+  KERNEL_CONTEXT *saved = (KERNEL_CONTEXT *) malloc(sizeof(KERNEL_CONTEXT));
+  SNAPSHOT_HEADER header;
+  STRIDE_QUEUE *stride;
+  BOOL ok;
+  int i;
+
+  if (!read_data(file, &header, sizeof(header)) ||
+    memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) ||
+    header.context_size != sizeof(KERNEL_CONTEXT) ||
+    header.page_size != sizeof(PROCESS_TABLE_PAGE) ||
+    header.cpus != NUMBER_OF_CPUS ||
+    header.levels != NUMBER_OF_PRIORITY_LEVELS ||
+    header.this_cpu < 0 || header.this_cpu >= NUMBER_OF_CPUS ||
+    header.scheduler < 0 || header.scheduler >= NUMBER_OF_SCHED_POLICIES ||
+    !read_data(file, saved, sizeof(KERNEL_CONTEXT)) ||
+    saved->process_table.page_count < 0)
+  {
+    free(saved);
+    return FALSE;
+  }
+
+  // Replace the saved context's pointers with this one's, reading in what
+  // they pointed to; those not read yet are NULL, so that everything read
+  // can be freed if the snapshot turns out to be short
+
+  saved->this_cpu = &context->cpus[header.this_cpu];
+  saved->scheduler = sched_policies[header.scheduler];
+  saved->process_table.empty_slots = NULL;
+  saved->process_table.empty_slot_listed = NULL;
+  saved->semaphores.semaphores = NULL;
+  saved->sync.rwlocks = NULL;
+  saved->sync.condvars = NULL;
+  saved->disk.pool = NULL;
+  saved->groups.groups = NULL;
+  saved->realtime.heap = NULL;
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+  {
+    stride = &saved->cpus[i].run_queue.stride;
+    stride->heap = NULL;
+    stride->tickets = NULL;
+    if (!has_heaps(saved))
+    {
+      stride->count = 0;
+      stride->capacity = 0;
+    }
+  }
+
+  ok = restore_process_table(&saved->process_table, file) &&
+    read_array(file, (void **) &saved->semaphores.semaphores,
+    sizeof(SEMAPHORE), saved->semaphores.capacity,
+    saved->semaphores.capacity) &&
+    read_array(file, (void **) &saved->sync.rwlocks, sizeof(RWLOCK),
+    saved->sync.rwlock_count, saved->sync.rwlock_count) &&
+    read_array(file, (void **) &saved->sync.condvars, sizeof(CONDVAR),
+    saved->sync.condvar_count, saved->sync.condvar_count) &&
+    read_array(file, (void **) &saved->disk.pool, sizeof(DISK_REQUEST),
+    saved->disk.pool_size, saved->disk.pool_size) &&
+    read_array(file, (void **) &saved->groups.groups, sizeof(GROUP),
+    saved->groups.count, saved->groups.capacity) &&
+    read_array(file, (void **) &saved->realtime.heap, sizeof(PID_type),
+    saved->realtime.count, saved->realtime.capacity);
+  for (i = 0; ok && i < NUMBER_OF_CPUS; i++)
+  {
+    stride = &saved->cpus[i].run_queue.stride;
+    ok = read_array(file, (void **) &stride->heap, sizeof(PID_type),
+      stride->count, stride->capacity) &&
+      read_array(file, (void **) &stride->tickets, sizeof(long long),
+      stride->count, stride->capacity);
+  }
+
+  if (!ok)
+  {
+    process_table_free(&saved->process_table);
+    semaphore_table_free(&saved->semaphores);
+    sync_table_free(&saved->sync);
+    disk_free(&saved->disk);
+    group_table_free(&saved->groups);
+    realtime_free(&saved->realtime);
+    for (i = 0; i < NUMBER_OF_CPUS; i++)
+      stride_policy.destroy(&saved->cpus[i].run_queue);
+    free(saved);
+    return FALSE;
+  }
+
+  // Where the output, log and metrics go stays as the context had it
+
+  saved->out = context->out;
+  saved->log_mode = context->log_mode;
+  saved->log = context->log;
+  saved->metrics_file = context->metrics_file;
+  saved->metrics_format = context->metrics_format;
+  saved->exit_on_halt = context->exit_on_halt;
+
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+    context->scheduler->destroy(&context->cpus[i].run_queue);
+  process_table_free(&context->process_table);
+  semaphore_table_free(&context->semaphores);
+  sync_table_free(&context->sync);
+  disk_free(&context->disk);
+  group_table_free(&context->groups);
+  realtime_free(&context->realtime);
+  *context = *saved;
+  free(saved);
+
+  install_handlers();
+  return TRUE;
+}
+
+int kernel_cpu_count()
+{
+  return NUMBER_OF_CPUS;
+}
+
+void kernel_select_cpu(int cpu)
+{
+  kernel->this_cpu = &kernel->cpus[cpu];
+  current_pid = kernel->this_cpu->current_pid;
+}
+
+CLOCK_TIME kernel_next_deadline()
+{
+  CLOCK_TIME timer, quantum, period;
+  int used, left;
+
+  if (kernel->result != KERNEL_RUNNING)
+    return NO_DEADLINE;
+
+  // Throttled processes are let go when the next period starts
+
+  timer = timer_next(&kernel->timers);
+  if (kernel->throttled.head != NO_PID)
+  {
+    period = (CLOCK_TIME) (kernel->throttled_period + 1) *
+      kernel->groups.period_length;
+    if (period < timer)
+      timer = period;
+  }
+
+  // An idle CPU looks for work (real-time, its own or stolen) at once when
+  // there is some, which it can only be when another CPU made it ready
+
+  if (current_pid == IDLE_PROCESS)
+    return kernel->realtime.count || kernel->this_cpu->run_queue.ready_count
+      || busiest_cpu() != NULL ? clock : timer;
+
+  // A real-time process with an earlier deadline preempts at once
+
+  if (preempted_by_realtime())
+    return clock;
+
+  // The quantum ends early if the process's group runs out of quota first
+  // (real-time processes are not held to it)
+
+  used = QUANTUM_USED();
+  left = realtime(current_pid) ? kernel->this_cpu->time_slice :
+    group_remaining(&kernel->groups, process_sched(current_pid)->group,
+    kernel->this_cpu->time_slice);
+  quantum = used >= left ? clock : (CLOCK_TIME) (left - used) >
+    LAST_TICK_TIME - clock ? NO_DEADLINE : clock + (left - used);
+  return timer < quantum ? timer : quantum;
+}
+
+void kernel_halt(KERNEL_RESULT result)
+{
+  int i;
+
+  kernel->result = result;
+  if (kernel->log != NULL)
+    event_log_drain(kernel->log);
+  if (kernel->metrics_file != NULL)
+    kernel_write_metrics(kernel, kernel->metrics_format,
+      kernel->metrics_file);
+  if (kernel->exit_on_halt)
+    exit(0);
+
+  // Leave every CPU idle so nothing runs after the end
+
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+    kernel->cpus[i].current_pid = IDLE_PROCESS;
+  current_pid = IDLE_PROCESS;
+}
+
+void handle_trap()
+{
+  kernel->traps++;
+  if (R1 == BATCH)
+    handle_batch();
+  else
+    run_operation();
+}
+
+void run_operation()
+{
+  kernel->operations++;
+
+  // Switch that handles what kind of trap occured
+
+  switch (R1)
+  {
+    case DISK_READ:
+      handle_disk_read();
+      break;
+    case DISK_WRITE:
+      disk_write_req(current_pid);
+      log_event(EVENT_DISK_WRITE, current_pid, 0);
+      break;
+    case KEYBOARD_READ:
+      handle_keyboard();
+      break;
+    case FORK_PROGRAM:
+      handle_fork();
+      break;
+    case END_PROGRAM:
+      handle_kill();
+      break;
+    case SEMAPHORE_OP:
+      handle_semaphore();
+      break;
+    case DISK_READ_ASYNC:
+      handle_disk_read_async();
+      break;
+    case DISK_WAIT:
+      handle_disk_wait();
+      break;
+    case SET_NICE:
+      handle_set_nice();
+      break;
+    case SLEEP:
+      handle_sleep();
+      break;
+    case GROUP_OP:
+      handle_group();
+      break;
+    case SET_REALTIME:
+      handle_set_realtime();
+      break;
+    case RWLOCK_OP:
+      handle_rwlock();
+      break;
+    case CONDVAR_OP:
+      handle_condvar();
+  }
+}
+
+void handle_batch()
+{
+  BATCH_BUFFER *batch = &kernel->batch;
+  PID_type pid = current_pid;
+  int count = R2 < 0 ? 0 : R2 < MAX_BATCH ? R2 : MAX_BATCH;
+  BATCH_OP *op;
+
+  log_event(EVENT_BATCH, pid, count);
+
+  // Each operation gets the registers its own trap would have had. Once
+  // the process is no longer running the rest are left for it to issue
+  // again.
+
+  for (batch->done = 0; batch->done < count; )
+  {
+    op = &batch->ops[batch->done++];
+    if (op->trap == BATCH)
+      continue;
+    R1 = op->trap;
+    R2 = op->arg;
+    R3 = op->arg2;
+    R4 = op->arg3;
+    run_operation();
+    if (current_pid != pid || kernel->result != KERNEL_RUNNING)
+      return;
+    op->arg = R2;
+  }
+  R2 = batch->done;
+}
+
+void handle_disk_read()
+{
+  log_event(EVENT_DISK_READ, current_pid, 0);
+
+  // Put request (through the disk scheduler, which takes where the read
+  // starts from R3 if the hardware puts it there) and update all the
+  // necessary counters
+
+  disk_submit(&kernel->disk, current_pid, R2,
+    kernel->full_registers ? R3 : NO_BLOCK, FALSE);
+  kernel->io_processes++;
+
+  // Block the process and schedule another one
+
+  block_current(BLOCKED_ON_DISK);
+}
+
+void handle_disk_read_async()
+{
+  PROCESS_COLD *cold = process_cold(current_pid);
+
+  // The process keeps running either way
+
+  if (cold->async_pending + cold->async_completed >= DISK_ASYNC_DEPTH)
+  {
+    log_event(EVENT_DISK_QUEUE_FULL, current_pid,
+      cold->async_pending + cold->async_completed);
+    R2 = FALSE;
+    return;
+  }
+
+  log_event(EVENT_DISK_READ_ASYNC, current_pid, 0);
+  disk_submit(&kernel->disk, current_pid, R2, R3, TRUE);
+  cold->async_pending++;
+  kernel->io_processes++;
+  R2 = TRUE;
+}
+
+void handle_disk_wait()
+{
+  PROCESS_COLD *cold = process_cold(current_pid);
+  int wanted = R2;
+
+  if (wanted > cold->async_completed + cold->async_pending)
+    wanted = cold->async_completed + cold->async_pending;
+
+  // Reap at once if enough reads have finished, otherwise block until they
+  // have (see handle_disk_interrupt())
+
+  if (cold->async_completed >= wanted)
+  {
+    log_event(EVENT_DISK_REAP, current_pid, cold->async_completed);
+    R2 = cold->async_completed;
+    cold->async_completed = 0;
+    return;
+  }
+
+  log_event(EVENT_DISK_WAIT, current_pid, wanted);
+  cold->async_wanted = wanted;
+  block_current(BLOCKED_ON_DISK);
+}
+
+void handle_keyboard()
+{
+  log_event(EVENT_KEYBOARD_READ, current_pid, 0);
+
+  // Put request and update all the necessary counters
+
+  keyboard_read_req(current_pid);
+  kernel->io_processes++;
+
+  // Block the process and schedule another one
+
+  block_current(BLOCKED_ON_KEYBOARD);
+}
+
+void handle_fork()
+{
+  int tickets = !kernel->full_registers ? DEFAULT_TICKETS :
+    R3 > 0 ? (R3 < MAX_TICKETS ? R3 : MAX_TICKETS) :
+    process_sched(current_pid)->tickets;
+  PID_type pid;
+
+  // Update process table with the new process; update counters. A
+  // negative PID gets a fresh one, handed back in R2. A PID already in use
+  // (or beyond the table, see process_table.h) is refused with NO_PID in
+  // R2, rather than taking over the process that has it.
+
+  if ((pid = process_create(R2)) == NO_PID)
+  {
+    log_event(EVENT_FORK_INVALID, current_pid, R2);
+    R2 = NO_PID;
+    return;
+  }
+  R2 = pid;
+  process_sched(R2)->tickets = tickets;
+  process_sched(R2)->group = process_sched(current_pid)->group;
+  kernel->active_processes++;
+
+  log_event(EVENT_FORK, R2, 0);
+
+  // Put new process to the ready queue, preferably on the parent's CPU
+
+  process_hot(R2)->cpu = kernel->this_cpu - kernel->cpus;
+  make_ready(R2);
+
+}
+
+void handle_kill()
+{
+  // Update process table and counter
+
+  charge_current(FALSE);
+  stop_share(current_pid);
+  kernel->active_processes--;
+
+  //STDOUT kill process message (after updating table since total time changes)
+  log_event(EVENT_EXIT, current_pid,
+    process_cold(current_pid)->total_CPU_time_used);
+  if (kernel->scheduler->report_shares)
+    report_share(current_pid);
+
+  record_exit_metrics(current_pid);
+  if (realtime(current_pid))
+  {
+    end_realtime_job(current_pid);
+    realtime_leave(&kernel->realtime, current_pid);
+  }
+  semaphore_release_all(&kernel->semaphores, current_pid);
+  release_rwlocks();
+  if (process_cold(current_pid)->async_pending)
+    disk_orphan(&kernel->disk, current_pid);
+  process_destroy(current_pid);
+
+  // Start the process on the ready queue
+  schedule();
+
+}
+
+void handle_semaphore()
+{
+  BOOL timed = R3 == SEMAPHORE_DOWN_TIMED;
+  SEMAPHORE *sem;
+  PID_type pid;
+  int length;
+
+  // Creating and destroying come first, as their R2 is not an open
+  // semaphore
+
+  if (R3 == SEMAPHORE_CREATE)
+  {
+    if (R2 < 0)
+    {
+      log_event(EVENT_SEMAPHORE_BAD_VALUE, current_pid, R2);
+      R2 = NO_SEMAPHORE;
+      return;
+    }
+    R2 = semaphore_create(&kernel->semaphores, R2);
+    log_event(EVENT_SEMAPHORE_CREATE, current_pid, R2);
+    return;
+  }
+  if (R3 == SEMAPHORE_DESTROY)
+  {
+    if (semaphore_destroy(&kernel->semaphores, R2))
+    {
+      log_event(EVENT_SEMAPHORE_DESTROY, current_pid, R2);
+      R2 = TRUE;
+    }
+    else
+    {
+      log_event(semaphore_get(&kernel->semaphores, R2) == NULL ?
+        EVENT_SEMAPHORE_INVALID : EVENT_SEMAPHORE_BUSY, current_pid, R2);
+      R2 = FALSE;
+    }
+    return;
+  }
+
+  // Temporary variable for semaphore (for simplicity); a bad ID is
+  // reported and the operation ignored
+
+  if ((sem = semaphore_get(&kernel->semaphores, R2)) == NULL)
+  {
+    log_event(EVENT_SEMAPHORE_INVALID, current_pid, R2);
+    return;
+  }
+
+  if (R3 == SEMAPHORE_UP)
+  {
+    log_event(EVENT_SEMAPHORE_UP, current_pid, R2);
+
+    // Check if the semaphore value is 0 and someone is waiting on it
+
+    if (!sem->value && (sem->ready_queue.head != NO_PID))
+    {
+      // Take the first waiting process off the semaphore, hand it the
+      // semaphore and make it ready
+
+      pid = dequeue(&sem->ready_queue);
+      timer_cancel(&kernel->timers, pid);
+      process_cold(pid)->waiting_on = NO_SEMAPHORE;
+      process_cold(pid)->deadlocked = FALSE;
+      kernel->semaphore_waiters--;
+      semaphore_set_owner(&kernel->semaphores, R2, pid);
+      make_ready(pid);
+    }
+    else
+    {
+      sem->value++;
+      if (sem->value > 1)
+        sem->counting = TRUE;
+      semaphore_set_owner(&kernel->semaphores, R2, NO_PID);
+    }
+  }
+  else // DOWN
+  {
+    log_event(EVENT_SEMAPHORE_DOWN, current_pid, R2);
+
+    // Check for non-zero value
+
+    if (sem->value)
+    {
+      sem->value--;
+      if (!sem->value)
+        semaphore_set_owner(&kernel->semaphores, R2, current_pid);
+      if (timed)
+        R2 = TRUE;
+    }
+    else if (timed && R4 <= 0)
+    {
+      // Give up at once rather than wait
+
+      log_event(EVENT_SEMAPHORE_TIMEOUT, current_pid, R2);
+      R2 = FALSE;
+    }
+    else
+    {
+      // Check whether waiting closes a deadlock cycle, and stop there if
+      // asked to and nothing else can break it (a wait with a timeout
+      // never closes one)
+
+      if (kernel->deadlock_mode != KERNEL_DEADLOCK_IGNORE && !timed &&
+        (length = find_deadlock(R2)))
+      {
+        report_deadlock(R2, length);
+        if (kernel->deadlock_mode == KERNEL_DEADLOCK_STOP &&
+          deadlock_is_final())
+        {
+          log_event(EVENT_DEADLOCK, IDLE_PROCESS, 0);
+          print_cpu_stats();
+          kernel_halt(KERNEL_DEADLOCKED);
+          return;
+        }
+      }
+
+      // Block the process on the semaphore's ready queue; start a process
+
+      enqueue(&sem->ready_queue, current_pid);
+      process_cold(current_pid)->waiting_on = R2;
+      kernel->semaphore_waiters++;
+      if (timed)
+        timer_add(&kernel->timers, current_pid, clock_after(R4));
+      block_current(BLOCKED_ON_SEMAPHORE);
+    }
+  }
+}
+
+void handle_set_nice()
+{
+  int nice = R2 < MIN_NICE ? MIN_NICE : R2 > MAX_NICE ? MAX_NICE : R2;
+
+  // The caller is running, so it is on no run queue; its new weight counts
+  // from the next time it is put on one
+
+  process_sched(current_pid)->nice = nice;
+  log_event(EVENT_SET_NICE, current_pid, nice);
+}
+
+void handle_sleep()
+{
+  log_event(EVENT_SLEEP, current_pid, R2 > 0 ? R2 : 0);
+  if (R2 <= 0)
+    return;
+
+  timer_add(&kernel->timers, current_pid, clock_after(R2));
+  block_current(BLOCKED_ON_TIMER);
+}
+
+CLOCK_TIME clock_after(int ms)
+{
+  return (CLOCK_TIME) ms > LAST_TICK_TIME - clock ? LAST_TICK_TIME :
+    clock + ms;
+}
+
+void handle_group()
+{
+  int group = process_sched(current_pid)->group;
+  int weight = R2 > 0 ? (R2 < MAX_GROUP_WEIGHT ? R2 : MAX_GROUP_WEIGHT) :
+    GROUP_WEIGHT;
+
+  if (R3 == GROUP_CREATE)
+  {
+    R2 = kernel->groups.groups[group].depth < MAX_GROUP_DEPTH ?
+      group_create(&kernel->groups, group, weight, R4 > 0 ? R4 : 0) :
+      NO_GROUP;
+    log_event(EVENT_GROUP_CREATE, current_pid, R2);
+    return;
+  }
+
+  if (group_get(&kernel->groups, R2) == NULL)
+  {
+    log_event(EVENT_GROUP_INVALID, current_pid, R2);
+    R2 = FALSE;
+    return;
+  }
+
+  // The process competes in its new group from now on; the rest of its
+  // quantum is charged there too, and if that group is throttled it is
+  // at the next clock interrupt
+
+  group_stop(&kernel->groups, group);
+  process_sched(current_pid)->group = R2;
+  group_start(&kernel->groups, R2);
+  log_event(EVENT_GROUP_JOIN, current_pid, R2);
+  R2 = TRUE;
+}
+
+void handle_set_realtime()
+{
+  PROCESS_SCHED *sched = process_sched(current_pid);
+  int runtime = R2, period = R3, deadline = R4 > 0 ? R4 : R3;
+  long long utilization;
+
+  // Leaving the class ends the current job; the policy takes the process
+  // back as if it had just woken up
+
+  if (runtime <= 0)
+  {
+    if (realtime(current_pid))
+    {
+      charge_current(FALSE);
+      end_realtime_job(current_pid);
+      realtime_leave(&kernel->realtime, current_pid);
+      kernel->scheduler->on_wake(&kernel->this_cpu->run_queue, current_pid);
+      kernel->this_cpu->time_slice = kernel->scheduler->time_slice(
+        &kernel->this_cpu->run_queue, current_pid);
+      log_event(EVENT_REALTIME_LEAVE, current_pid, 0);
+    }
+    R2 = TRUE;
+    return;
+  }
+
+  // The class must have room for the process (beyond whatever it has
+  // already). Time used so far is charged the way the process was
+  // scheduled, and its first job (or, already real-time, a new one)
+  // starts now.
+
+  if (runtime > deadline || deadline > period)
+  {
+    log_event(EVENT_REALTIME_INVALID, current_pid, 0);
+    R2 = FALSE;
+    return;
+  }
+  utilization = realtime_fits(&kernel->realtime, current_pid, runtime,
+    deadline);
+  if (utilization < 0)
+  {
+    log_event(EVENT_REALTIME_REJECT, current_pid, 0);
+    R2 = FALSE;
+    return;
+  }
+
+  charge_current(FALSE);
+  if (realtime(current_pid))
+    end_realtime_job(current_pid);
+  realtime_admit(&kernel->realtime, current_pid, runtime, deadline, period);
+  kernel->this_cpu->time_slice = sched->rt_budget;
+  log_event(EVENT_REALTIME_ADMIT, current_pid,
+    (int) (10000 * utilization / RT_UNIT));
+  R2 = TRUE;
+}
+
+void handle_rwlock()
+{
+  // Only a process holding the lock may unlock it, and one holding it
+  // may not lock it again
+
+  if (rwlock_get(&kernel->sync, R2) == NULL ||
+    rwlock_held(current_pid, R2) != (R3 == RWLOCK_UNLOCK))
+  {
+    log_event(EVENT_RWLOCK_INVALID, current_pid, R2);
+    return;
+  }
+
+  if (R3 == RWLOCK_UNLOCK)
+  {
+    log_event(EVENT_RWLOCK_UNLOCK, current_pid, R2);
+    release_rwlock(R2);
+    return;
+  }
+
+  log_event(R3 == RWLOCK_WRITE ? EVENT_RWLOCK_WRITE : EVENT_RWLOCK_READ,
+    current_pid, R2);
+  if (rwlock_acquire(&kernel->sync, R2, current_pid, R3 == RWLOCK_WRITE))
+    return;
+
+  // Wait on the lock's queue until it is handed over (see release_rwlock())
+
+  process_cold(current_pid)->sync_lock = R2;
+  block_current(BLOCKED_ON_RWLOCK);
+}
+
+void handle_condvar()
+{
+  PROCESS_COLD *cold = process_cold(current_pid);
+  PID_QUEUE woken = { NO_PID, NO_PID };
+  RWLOCK *lock;
+  PID_type pid;
+
+  if (condvar_get(&kernel->sync, R2) == NULL)
+  {
+    log_event(EVENT_CONDVAR_INVALID, current_pid, R2);
+    return;
+  }
+
+  if (R3 == CONDVAR_SIGNAL)
+  {
+    log_event(EVENT_CONDVAR_SIGNAL, current_pid, R2);
+    if ((pid = condvar_signal(&kernel->sync, R2)) != NO_PID)
+      wake_condvar(pid, R2);
+    return;
+  }
+  if (R3 == CONDVAR_BROADCAST)
+  {
+    // Everyone waiting is taken off at once
+
+    log_event(EVENT_CONDVAR_BROADCAST, current_pid, R2);
+    condvar_broadcast(&kernel->sync, R2, &woken);
+    while (woken.head != NO_PID)
+      wake_condvar(dequeue(&woken), R2);
+    return;
+  }
+
+  // A WAIT gives up the lock, remembering how it was held
+
+  lock = rwlock_get(&kernel->sync, R4);
+  if (lock == NULL || !rwlock_held(current_pid, R4))
+  {
+    log_event(EVENT_RWLOCK_INVALID, current_pid, R4);
+    return;
+  }
+
+  log_event(EVENT_CONDVAR_WAIT, current_pid, R2);
+  cold->sync_lock = R4;
+  cold->sync_write = lock->writer == current_pid;
+  release_rwlock(R4);
+  condvar_wait(&kernel->sync, R2, current_pid);
+  block_current(BLOCKED_ON_CONDVAR);
+}
+
+void handle_clock_interrupt()
+{
+  PID_type pid;
+
+  unthrottle();
+
+  // Wake the processes whose timers have expired (or whose group has a new
+  // quota). An idle CPU runs one of them, or anything another CPU made
+  // ready since it went idle.
+
+  while ((pid = timer_expire(&kernel->timers, clock)) != NO_PID)
+    wake_timer(pid);
+  if (current_pid == IDLE_PROCESS && (kernel->realtime.count ||
+    kernel->this_cpu->run_queue.ready_count || busiest_cpu() != NULL))
+    schedule();
+
+  // Check for idle process and for going over quantum limit, or a
+  // real-time process to run first
+
+  if ((current_pid != IDLE_PROCESS) &&
+    (QUANTUM_USED() >= kernel->this_cpu->time_slice ||
+    preempted_by_realtime()))
+  {
+    // Update the table (and let the scheduler demote it if it used up its
+    // quantum)
+
+    charge_current(QUANTUM_USED() >= kernel->this_cpu->time_slice);
+
+    // Reschedule the process
+
+    make_ready(current_pid);
+
+    // Schedule new process
+
+    schedule();
+  }
+  else if (current_pid != IDLE_PROCESS && !realtime(current_pid) &&
+    group_remaining(&kernel->groups, process_sched(current_pid)->group,
+    QUANTUM_USED() + 1) <= QUANTUM_USED())
+  {
+    // The process's group has used up its quota; the process keeps its
+    // priority, as its quantum was cut short through no choice of its own
+
+    charge_current(FALSE);
+    throttle(current_pid);
+    schedule();
+  }
+}
+
+void handle_disk_interrupt()
+{
+  REQUEST_LIST done;
+  DISK_REQUEST *read;
+  PROCESS_COLD *cold;
+  int request;
+
+  // The request can have completed several merged reads
+
+  disk_complete(&kernel->disk, R1, &done);
+  while ((request = disk_pop(&kernel->disk, &done)) != NO_REQUEST)
+  {
+    read = &kernel->disk.pool[request];
+
+    // Update the counters
+
+    kernel->io_processes--;
+
+    // Nothing is left to tell about the reads of a process that exited
+
+    if (read->orphaned)
+    {
+      disk_release(&kernel->disk, request);
+      continue;
+    }
+
+    log_event(EVENT_DISK_INTERRUPT, read->pid, 0);
+    if (!read->async)
+    {
+      // Enqueue the process
+
+      make_ready(read->pid);
+    }
+    else
+    {
+      // Record the finished read; the process only has to run again if it
+      // is waiting for enough of them
+
+      cold = process_cold(read->pid);
+      cold->async_pending--;
+      cold->async_completed++;
+      if (cold->async_wanted && cold->async_completed >= cold->async_wanted)
+      {
+        log_event(EVENT_DISK_REAP, read->pid, cold->async_completed);
+        cold->async_completed = 0;
+        cold->async_wanted = 0;
+        make_ready(read->pid);
+      }
+    }
+    disk_release(&kernel->disk, request);
+  }
+
+  // Start a new process if idle
+
+  if (current_pid == IDLE_PROCESS)
+    schedule();
+
+}
+
+void handle_keyboard_interrupt()
+{
+  log_event(EVENT_KEYBOARD_INTERRUPT, R1, 0);
+
+  // Update table and counters; enqueue process or start a new one if idle
+
+  kernel->io_processes--;
+  make_ready(R1);
+  if (current_pid == IDLE_PROCESS)
+    schedule();
+
+}
+
+void schedule()
+{
+  CPU *cpu = kernel->this_cpu;
+  RUN_QUEUE *run_queue;
+  CPU *victim;
+  PROCESS_COLD *cold;
+  BOOL stolen;
+  int i;
+
+  // Nothing runs once the simulation has ended
+
+  if (kernel->result != KERNEL_RUNNING)
+  {
+    current_pid = IDLE_PROCESS;
+    return;
+  }
+
+  // Stop if no active processes left
+
+  if (!kernel->active_processes)
+  {
+    log_event(EVENT_FINISHED, IDLE_PROCESS, 0);
+    print_cpu_stats();
+    print_group_stats();
+    kernel_halt(KERNEL_FINISHED);
+    return;
+  }
+
+  // Real-time processes run before any other, the earliest deadline
+  // first (see realtime.h)
+
+  run_queue = &cpu->run_queue;
+  stolen = FALSE;
+  current_pid = realtime_pop(&kernel->realtime);
+
+  // Otherwise the scheduler picks from the CPU's run queue. With nothing
+  // of its own to run, an idle CPU steals from the CPU with the most ready
+  // processes. A process picked whose group is out of quota is throttled
+  // instead, and the next one picked.
+
+  while (current_pid == NO_PID)
+  {
+    run_queue = &cpu->run_queue;
+    stolen = !run_queue->ready_count && (victim = busiest_cpu()) != NULL;
+    if (stolen)
+      run_queue = &victim->run_queue;
+    if (!run_queue->ready_count)
+      break;
+
+    current_pid = kernel->scheduler->pick_next(run_queue);
+    kernel->scheduler->dequeue(run_queue, current_pid);
+    run_queue->ready_count--;
+    if (group_throttled(&kernel->groups, process_sched(current_pid)->group))
+    {
+      throttle(current_pid);
+      current_pid = NO_PID;
+    }
+  }
+  if (stolen)
+    cpu->steals++;
+
+  // Handle case when every ready queue is empty
+
+  if (current_pid == NO_PID)
+  {
+    // If no IO, timer or throttled process pending and no other CPU
+    // running - deadlocked system
+
+    for (i = 0; i < NUMBER_OF_CPUS; i++)
+      if (&kernel->cpus[i] != cpu &&
+        kernel->cpus[i].current_pid != IDLE_PROCESS)
+        break;
+
+    if (!kernel->io_processes && !kernel->timers.count &&
+      kernel->throttled.head == NO_PID && i == NUMBER_OF_CPUS)
+    {
+      log_event(EVENT_DEADLOCK, IDLE_PROCESS, 0);
+      print_cpu_stats();
+      print_group_stats();
+      kernel_halt(KERNEL_DEADLOCKED);
+      return;
+    }
+
+    // If IO present - process idle; update pid
+
+    log_event(EVENT_IDLE, IDLE_PROCESS, 0);
+    current_pid = IDLE_PROCESS;
+    cpu->current_pid = IDLE_PROCESS;
+    return;
+  }
+
+  // Update the table; run the process picked
+
+  cold = process_cold(current_pid);
+  histogram_record(
+    &kernel->metrics.level_wait[process_hot(current_pid)->priority],
+    clock - cold->state_since);
+  if (clock - cold->state_since >= STARVATION_TIME)
+    cpu->starved++;
+  if (current_pid != cpu->last_pid)
+    cpu->switches++;
+  cpu->last_pid = current_pid;
+  cold->wait_time += clock - cold->state_since;
+  if (cold->first_run_time < 0)
+    cold->first_run_time = clock;
+  cold->state_since = clock;
+
+  if (process_hot(current_pid)->cpu != cpu - kernel->cpus)
+  {
+    process_hot(current_pid)->cpu = cpu - kernel->cpus;
+    cpu->migrations++;
+  }
+  if (run_queue != &cpu->run_queue)
+    kernel->scheduler->on_wake(&cpu->run_queue, current_pid);
+  cpu->current_pid = current_pid;
+  cpu->quantum_start_time = clock;
+  cpu->time_slice = realtime(current_pid) ?
+    process_sched(current_pid)->rt_budget :
+    kernel->scheduler->time_slice(&cpu->run_queue, current_pid);
+  process_hot(current_pid)->state = RUNNING;
+  log_event(EVENT_RUN, current_pid, 0);
+}
+
+int cpu_load(CPU *cpu)
+{
+  return cpu->run_queue.ready_count + (cpu->current_pid != IDLE_PROCESS);
+}
+
+CPU *busiest_cpu()
+{
+  CPU *busiest = NULL;
+  int i;
+
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+    if (kernel->cpus[i].run_queue.ready_count &&
+      (busiest == NULL ||
+      kernel->cpus[i].run_queue.ready_count > busiest->run_queue.ready_count))
+      busiest = &kernel->cpus[i];
+  return busiest;
+}
+
+CPU *select_cpu(PID_type pid)
+{
+  CPU *preferred = &kernel->cpus[process_hot(pid)->cpu];
+  CPU *least = preferred;
+  int i;
+
+  // Stay on the CPU the process last ran on (or its parent's CPU, for a new
+  // process) unless another CPU has at least two fewer processes to run
+
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+    if (cpu_load(&kernel->cpus[i]) < cpu_load(least))
+      least = &kernel->cpus[i];
+  return cpu_load(least) + 1 < cpu_load(preferred) ? least : preferred;
+}
+
+void print_cpu_stats()
+{
+  int i;
+
+  if (NUMBER_OF_CPUS == 1)
+    return;
+
+  for (i = 0; i < NUMBER_OF_CPUS; i++)
+    fprintf(kernel->out,
+      "CPU %d: busy %d ms of %d ms (%.1f%%), %d migrations, %d steals\n",
+      i, kernel->cpus[i].busy_time, clock,
+      clock ? 100.0 * kernel->cpus[i].busy_time / clock : 0.0,
+      kernel->cpus[i].migrations, kernel->cpus[i].steals);
+}
+
+void print_group_stats()
+{
+  GROUP *group;
+  int i;
+
+  if (kernel->groups.count == 1)
+    return;
+
+  for (i = 0; i < kernel->groups.count; i++)
+  {
+    group = &kernel->groups.groups[i];
+    fprintf(kernel->out, "Group %d: parent %d, weight %d, quota %d ms, "
+      "used %lld ms of CPU time (%.1f%%), throttled %d times\n", i,
+      group->parent, group->weight, group->quota, group->total_usage,
+      kernel->busy_total ? 100.0 * group->total_usage / kernel->busy_total :
+      0.0, group->throttles);
+  }
+}
+
+int find_deadlock(int id)
+{
+  PID_type pid;
+  PROCESS_COLD *cold;
+  int length = 1;
+
+  // Follow owners until one is not waiting on a semaphore. A process in a
+  // cycle reported before cannot lead back here (it waits for its own
+  // cycle), and the chain can be no longer than the number of waiting
+  // processes.
+
+  while ((pid = kernel->semaphores.semaphores[id].owner) != current_pid)
+  {
+    if (pid == NO_PID || process_hot(pid)->state != BLOCKED)
+      return 0;
+    cold = process_cold(pid);
+    if (cold->waiting_on == NO_SEMAPHORE || cold->deadlocked ||
+      cold->timer_slot != NO_TIMER || length > kernel->semaphore_waiters)
+      return 0;
+    id = cold->waiting_on;
+    length++;
+  }
+  return length;
+}
+
+void report_deadlock(int id, int length)
+{
+  PID_type pid = current_pid;
+
+  kernel->deadlocks++;
+  log_event(EVENT_DEADLOCK_CYCLE, current_pid, length);
+
+  // Walk the cycle again, from the running process
+
+  while (length--)
+  {
+    log_event(EVENT_DEADLOCK_WAIT, pid, id);
+    process_cold(pid)->deadlocked = TRUE;
+    pid = kernel->semaphores.semaphores[id].owner;
+    id = process_cold(pid)->waiting_on;
+  }
+}
+
+BOOL deadlock_is_final()
+{
+  // Every process but the running one must be waiting on a semaphore, and
+  // none of them with a timeout (the only timers left would be theirs)
+
+  return process_table->live - 1 == kernel->semaphore_waiters &&
+    !kernel->timers.count;
+}
+
+void record_exit_metrics(PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+  KERNEL_METRICS *metrics = &kernel->metrics;
+  int i;
+
+  histogram_record(&metrics->cpu_time, cold->total_CPU_time_used);
+  histogram_record(&metrics->wait_time, cold->wait_time);
+  histogram_record(&metrics->response_time,
+    cold->first_run_time - cold->created_time);
+  histogram_record(&metrics->turnaround_time, clock - cold->created_time);
+  for (i = 0; i < NUMBER_OF_BLOCK_REASONS; i++)
+    histogram_record(&metrics->blocked_time[i], cold->blocked_time[i]);
+}
+
+void start_share(PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+
+  kernel->runnable_tickets += process_sched(pid)->tickets;
+  group_start(&kernel->groups, process_sched(pid)->group);
+  cold->share_busy -= kernel->busy_total;
+  cold->share_ticket_time -= kernel->ticket_time;
+}
+
+void stop_share(PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+
+  kernel->runnable_tickets -= process_sched(pid)->tickets;
+  group_stop(&kernel->groups, process_sched(pid)->group);
+  cold->share_busy += kernel->busy_total;
+  cold->share_ticket_time += kernel->ticket_time;
+}
+
+void report_share(PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+  int achieved = 0, requested = 0;
+
+  // Both in hundredths of a percent of the CPU time used while the process
+  // was competing for it. What it asked for is its tickets' share of the
+  // tickets competing, averaged over that time.
+
+  if (cold->share_busy)
+    achieved = (int) (10000.0 * cold->total_CPU_time_used /
+      cold->share_busy);
+  if (cold->share_ticket_time)
+    requested = (int) (10000.0 * process_sched(pid)->tickets *
+      cold->share_busy / cold->share_ticket_time);
+  log_event(EVENT_SHARE, pid, achieved << 16 | requested);
+}
+
+void log_event(EVENT_TYPE type, PID_type pid, int arg)
+{
+  EVENT_RECORD record;
+
+  kernel->event_counts[type]++;
+  if (kernel->log_mode == KERNEL_LOG_QUIET)
+    return;
+
+  record.time = clock;
+  record.type = type;
+  record.cpu = kernel->this_cpu - kernel->cpus;
+  record.pid = pid;
+  record.arg = arg;
+
+  if (kernel->log_mode == KERNEL_LOG_TEXT)
+    event_format(kernel->out, &record);
+  else
+    event_log_put(kernel->log, &record);
+}
+
+void enqueue(PID_QUEUE *queue, PID_type pid)
+{
+  process_links(pid)->next = NO_PID;
+  process_links(pid)->prev = queue->tail;
+
+  // Link to tail (and head if it's empty)
+  if (queue->head == NO_PID)
+    queue->head = pid;
+  else
+    process_links(queue->tail)->next = pid;
+  queue->tail = pid;
+}
+
+PID_type dequeue(PID_QUEUE *queue)
+{
+  PID_type pid = queue->head;
+
+  queue->head = process_links(pid)->next;
+  if (queue->head == NO_PID)
+    queue->tail = NO_PID;
+  else
+    process_links(queue->head)->prev = NO_PID;
+  return pid;
+}
+
+void unqueue(PID_QUEUE *queue, PID_type pid)
+{
+  PROCESS_LINKS *links = process_links(pid);
+
+  if (links->prev == NO_PID)
+    queue->head = links->next;
+  else
+    process_links(links->prev)->next = links->next;
+  if (links->next == NO_PID)
+    queue->tail = links->prev;
+  else
+    process_links(links->next)->prev = links->prev;
+}
+
+void make_ready(PID_type pid)
+{
+  CPU *cpu = select_cpu(pid);
+  PROCESS_COLD *cold = process_cold(pid);
+
+  if (process_hot(pid)->state == BLOCKED)
+    cold->blocked_time[cold->block_reason] += clock - cold->state_since;
+  cold->state_since = clock;
+
+  // Only a preempted process that stays on its CPU is not woken
+
+  if (process_hot(pid)->state != RUNNING)
+    start_share(pid);
+
+  // A real-time process waits on the class's heap rather than a run queue,
+  // starting a new job unless it was preempted or throttled, in which case
+  // the job carries on if it has budget
+
+  if (realtime(pid))
+  {
+    if (process_hot(pid)->state == RUNNING ||
+      (process_hot(pid)->state == BLOCKED &&
+      cold->block_reason == BLOCKED_ON_QUOTA))
+    {
+      if (!realtime_refill(pid))
+      {
+        throttle_realtime(pid);
+        return;
+      }
+    }
+    else
+      realtime_start_job(pid);
+    process_hot(pid)->state = READY;
+    realtime_push(&kernel->realtime, pid);
+    return;
+  }
+
+  if (process_hot(pid)->state != RUNNING ||
+    process_hot(pid)->cpu != cpu - kernel->cpus)
+    kernel->scheduler->on_wake(&cpu->run_queue, pid);
+
+  process_hot(pid)->state = READY;
+  kernel->scheduler->enqueue(&cpu->run_queue, pid);
+  cpu->run_queue.ready_count++;
+}
+
+void charge_current(BOOL expired)
+{
+  int used = QUANTUM_USED();
+  int group = process_sched(current_pid)->group;
+
+  process_cold(current_pid)->total_CPU_time_used += used;
+  histogram_record(
+    &kernel->metrics.level_run[process_hot(current_pid)->priority], used);
+  kernel->this_cpu->busy_time += used;
+  kernel->this_cpu->quantum_start_time = clock;
+  kernel->busy_total += used;
+  kernel->ticket_time += (long long) used * kernel->runnable_tickets;
+  group_charge(&kernel->groups, group, used);
+
+  // A real-time job uses its budget rather than the policy's time. Policies
+  // that weigh processes weigh their groups too.
+
+  if (realtime(current_pid))
+    realtime_charge(current_pid, used);
+  else
+    kernel->scheduler->tick(&kernel->this_cpu->run_queue, current_pid,
+      weighs_groups(kernel) ? group_weigh(&kernel->groups, group, used) :
+      used, expired);
+}
+
+void wake_timer(PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+
+  // A timed out DOWN leaves the semaphore's queue without it
+
+  if (cold->block_reason == BLOCKED_ON_SEMAPHORE)
+  {
+    log_event(EVENT_SEMAPHORE_TIMEOUT, pid, cold->waiting_on);
+    unqueue(&kernel->semaphores.semaphores[cold->waiting_on].ready_queue,
+      pid);
+    cold->waiting_on = NO_SEMAPHORE;
+    kernel->semaphore_waiters--;
+  }
+  else if (cold->block_reason == BLOCKED_ON_QUOTA)
+    log_event(EVENT_UNTHROTTLE, pid, 0);
+  else
+    log_event(EVENT_WAKE, pid, 0);
+  make_ready(pid);
+}
+
+void throttle(PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+
+  // Processes throttled in an earlier period go first, so that everything
+  // on the queue is let go together
+
+  unthrottle();
+  log_event(EVENT_THROTTLE, pid, process_sched(pid)->group);
+  if (process_hot(pid)->state == READY)
+    cold->wait_time += clock - cold->state_since;
+  process_hot(pid)->state = BLOCKED;
+  cold->block_reason = BLOCKED_ON_QUOTA;
+  cold->state_since = clock;
+  stop_share(pid);
+  enqueue(&kernel->throttled, pid);
+  kernel->throttled_period = group_period(&kernel->groups);
+}
+
+void throttle_realtime(PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+  CLOCK_TIME until = process_sched(pid)->rt_abs_deadline;
+
+  log_event(EVENT_BUDGET_THROTTLE, pid, until);
+  stop_share(pid);
+  process_hot(pid)->state = BLOCKED;
+  cold->block_reason = BLOCKED_ON_QUOTA;
+  cold->state_since = clock;
+  timer_add(&kernel->timers, pid, until);
+}
+
+BOOL unthrottle()
+{
+  PID_type pid;
+
+  if (kernel->throttled.head == NO_PID ||
+    kernel->throttled_period == group_period(&kernel->groups))
+    return FALSE;
+
+  while (kernel->throttled.head != NO_PID)
+  {
+    pid = dequeue(&kernel->throttled);
+    log_event(EVENT_UNTHROTTLE, pid, 0);
+    make_ready(pid);
+  }
+  return TRUE;
+}
+
+BOOL preempted_by_realtime()
+{
+  PID_type first = realtime_first(&kernel->realtime);
+
+  return first != NO_PID && (!realtime(current_pid) ||
+    process_sched(first)->rt_abs_deadline <
+    process_sched(current_pid)->rt_abs_deadline);
+}
+
+void end_realtime_job(PID_type pid)
+{
+  int tardiness = realtime_end_job(&kernel->realtime, pid);
+
+  if (tardiness)
+    log_event(EVENT_DEADLINE_MISS, pid, tardiness);
+  histogram_record(&kernel->metrics.rt_tardiness, tardiness);
+}
+
+void release_rwlock(int id)
+{
+  PID_QUEUE granted = { NO_PID, NO_PID };
+  PID_type pid;
+
+  // Every process the lock goes to comes off its queue in one go
+
+  rwlock_release(&kernel->sync, id, current_pid, &granted);
+  while (granted.head != NO_PID)
+  {
+    pid = dequeue(&granted);
+    log_event(EVENT_RWLOCK_GRANT, pid, id);
+    process_cold(pid)->sync_lock = NO_RWLOCK;
+    make_ready(pid);
+  }
+}
+
+void release_rwlocks()
+{
+  unsigned int held = process_cold(current_pid)->rwlocks_held;
+
+  for (; held; held &= held - 1)
+  {
+    log_event(EVENT_RWLOCK_UNLOCK, current_pid, __builtin_ctz(held));
+    release_rwlock(__builtin_ctz(held));
+  }
+}
+
+void wake_condvar(PID_type pid, int id)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+
+  log_event(EVENT_CONDVAR_WAKE, pid, id);
+  if (rwlock_acquire(&kernel->sync, cold->sync_lock, pid, cold->sync_write))
+  {
+    log_event(EVENT_RWLOCK_GRANT, pid, cold->sync_lock);
+    cold->sync_lock = NO_RWLOCK;
+    make_ready(pid);
+    return;
+  }
+
+  // The time blocked so far was spent on the condition variable
+
+  cold->blocked_time[BLOCKED_ON_CONDVAR] += clock - cold->state_since;
+  cold->block_reason = BLOCKED_ON_RWLOCK;
+  cold->state_since = clock;
+}
+
+void block_current(BLOCK_REASON reason)
+{
+  BOOL early = QUANTUM_USED() < kernel->this_cpu->time_slice;
+
+  process_hot(current_pid)->state = BLOCKED;
+  process_cold(current_pid)->block_reason = reason;
+  process_cold(current_pid)->state_since = clock;
+
+  // Restart current quantum when a process gets blocked (charging the time
+  // at the level it ran at) and start a process
+
+  charge_current(FALSE);
+  stop_share(current_pid);
+  if (realtime(current_pid))
+    end_realtime_job(current_pid);
+  else
+    kernel->scheduler->on_block(&kernel->this_cpu->run_queue, current_pid,
+      early);
+  schedule();
 }
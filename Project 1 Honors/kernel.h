@@ -1,6 +1,349 @@
+#include <stdio.h>  /* FILE, for the functions taking streams */
 
 /* This must be implemented by the kernel. It will
    be called automatically during (simulated) system
    initialization */
 
 extern void initialize_kernel();
+
+/* All of the kernel's state is kept in a KERNEL_CONTEXT. The stand-alone
+   system never sees one: initialize_kernel() makes a default context
+   that exits the program when the run ends. A driver running many
+   simulations in one process instead creates a context per simulation
+   and selects it on the thread running that simulation before calling
+   initialize_kernel(); the kernel then returns from the interrupt that
+   ends the run and the outcome is read with kernel_result(). */
+
+typedef enum {
+  KERNEL_RUNNING,    /* the simulation has not ended */
+  KERNEL_FINISHED,   /* every process exited */
+  KERNEL_DEADLOCKED  /* processes are left, but none can ever run */
+} KERNEL_RESULT;
+
+typedef struct kernel_context KERNEL_CONTEXT;
+
+/* Creates a context for a new simulation. Its messages go to stdout. */
+
+extern KERNEL_CONTEXT *kernel_create();
+
+/* Makes the kernel use a context on the calling thread */
+
+extern void kernel_select(KERNEL_CONTEXT *context);
+
+/* Sends a context's messages to another (open) stream */
+
+extern void kernel_set_output(KERNEL_CONTEXT *context, FILE *out);
+
+/* How a context reports what the kernel does. In text mode (the default)
+   every event is printed as it happens. In binary mode events are put,
+   as EVENT_RECORDs, in a ring buffer that is written to the log file in
+   bulk, and event_decode prints them later exactly as text mode would
+   have. In quiet mode events are only counted. Summary lines (the
+   per-CPU statistics) are always printed as text. */
+
+typedef enum {
+  KERNEL_LOG_TEXT,    /* print events to file */
+  KERNEL_LOG_BINARY,  /* write binary event records to file */
+  KERNEL_LOG_QUIET    /* count events only; file is unused */
+} KERNEL_LOG_MODE;
+
+extern void kernel_set_log(KERNEL_CONTEXT *context, KERNEL_LOG_MODE mode,
+  FILE *file);
+
+/* Returns how many events of a type (an EVENT_TYPE, see event_log.h) a
+   context has had */
+
+extern unsigned long kernel_event_count(KERNEL_CONTEXT *context, int type);
+
+/* Replaces a context's semaphore table (normally NUMBER_OF_SEMAPHORES
+   semaphores, all open) with one of capacity semaphores, of which the
+   first open are open and the rest can be created by processes (see
+   semaphore.h). Must be done before the run starts. */
+
+extern void kernel_set_semaphores(KERNEL_CONTEXT *context, int capacity,
+  int open);
+
+/* Traps the supplied hardware does not issue, for hardware models that
+   want them (see simulator.c). Like the others, the trap is in R1.
+
+   DISK_READ_ASYNC submits a disk read (size in R2, first block in R3, see
+   disk.h) and returns at once, with R2 TRUE, so the process can compute
+   while the disk works; R2 is FALSE, and nothing is submitted, if the
+   process already has DISK_ASYNC_DEPTH reads it has not reaped. The
+   DISK_INTERRUPT of a finished read only records it, without taking the
+   CPU from anyone.
+
+   DISK_WAIT reaps the process's finished reads, first blocking until at
+   least R2 of them have finished (at most as many as it has submitted).
+   If it does not block R2 is set to the number reaped. */
+
+#define DISK_READ_ASYNC 6
+#define DISK_WAIT 7
+
+#define DISK_ASYNC_DEPTH 32
+
+/* FORK_PROGRAM gives the new process R3 tickets (see scheduler.h), at
+   most MAX_TICKETS, or if R3 is not positive as many as its parent has,
+   if the hardware puts them there (see kernel_set_full_registers()).
+
+   SET_NICE sets the calling process's nice value to R2, clamped to
+   MIN_NICE..MAX_NICE (see scheduler.h). Lower is a larger share of the
+   CPU under CFS; MLFQ ignores it. */
+
+#define SET_NICE 8
+
+/* SLEEP blocks the calling process for R2 ms: it is woken at the first
+   clock interrupt at or after then (see timer.h). A sleep of 0 ms or less
+   returns at once.
+
+   SEMAPHORE_OP with R3 = SEMAPHORE_DOWN_TIMED (see semaphore.h) is a DOWN
+   that gives up after R4 ms, or at once if R4 is 0 or less, if it has
+   not got the semaphore by then. R2 is set to TRUE if it got it without
+   waiting and to FALSE if it gave up at once; a process that waited learns
+   nothing, as the registers belong to whoever runs when it is woken, but
+   the kernel reports whether it got the semaphore or gave up. Waiting with
+   a timeout cannot close a deadlock cycle, since it ends. */
+
+#define SLEEP 9
+
+/* GROUP_OP, with R3 one of the operations in group.h, creates a group
+   below the calling process's group (R2 = its weight, R4 = its quota) or
+   moves the calling process into a group (R2 = its ID, set to FALSE if
+   there is no such group and to TRUE otherwise). A forked process starts
+   in its parent's group.
+
+   A process whose group, or a group above it, has used up its quota is
+   preempted, BLOCKED_ON_QUOTA, until the next group period starts. The
+   CPU time used by every group is reported when the run ends. */
+
+#define GROUP_OP 10
+
+/* Sets how long a group period is, in ms (GROUP_PERIOD by default, see
+   group.h). Must be done before the run starts. */
+
+extern void kernel_set_group_period(KERNEL_CONTEXT *context, int period);
+
+/* SET_REALTIME puts the calling process in the real-time class (see
+   realtime.h), which runs before the scheduling policy, earliest deadline
+   first: R2 = its runtime, R3 = its period and R4 = its relative deadline
+   (the period if 0 or less), all in ms, with 0 < runtime <= deadline <=
+   period. R2 is set to TRUE if it was admitted and to FALSE if the class
+   has no room for it or the times are out of order. A job that uses up
+   its runtime is preempted, BLOCKED_ON_QUOTA, until its deadline. With
+   R2 0 or less the process leaves the class. A forked process is never
+   real-time. */
+
+#define SET_REALTIME 11
+
+/* Returns how many real-time jobs have ended, and how many of them after
+   their deadline. How late they were is in the metrics (rt_tardiness). */
+
+extern void kernel_realtime_stats(KERNEL_CONTEXT *context, int *jobs,
+  int *misses);
+
+/* RWLOCK_OP, with R3 one of the lock operations in sync.h, locks
+   reader-writer lock R2 for reading or writing, blocking until the lock
+   can be had, or unlocks it. CONDVAR_OP, with R3 one of the condition
+   variable operations there, waits on condition variable R2, giving up
+   lock R4 (which the process must hold) until woken and then taking it
+   back the way it had it, or wakes the first or every process waiting on
+   R2. Using a lock that does not exist, locking one the process already
+   holds, or unlocking or waiting with one it does not hold, is reported
+   and ignored. The locks a process still holds when it exits are
+   unlocked. There are NUMBER_OF_RWLOCKS locks and NUMBER_OF_CONDVARS
+   condition variables (see kernel.c). */
+
+#define RWLOCK_OP 12
+#define CONDVAR_OP 13
+
+/* Sets how a context's reader-writer locks order their waiters: an
+   RWLOCK_WRITER_PREFERRED (the default) or RWLOCK_FAIR mode from sync.h.
+   Must be done before the run starts. */
+
+extern void kernel_set_rwlock_mode(KERNEL_CONTEXT *context, int mode);
+
+/* BATCH runs a vector of operations, each what a trap of its own would
+   have done, in one trap. The hardware puts them in the context's batch
+   (see kernel_batch()), each as the R1 to R4 of its trap, and R2 is how
+   many there are, at most MAX_BATCH. They run in order until one takes
+   the CPU from the process, by blocking or exiting, which is the last to
+   run; a BATCH among them does nothing. The batch's done is set to how
+   many ran, the blocking one included. Every operation that ran and left
+   the process running has its R2 afterwards put back in its arg; the
+   blocking one's arg is left as it was, since, as with a trap of its own,
+   a process that waited learns nothing from the registers. A process
+   that did not block also gets the count in R2. */
+
+#define BATCH 14
+
+#define MAX_BATCH 64
+
+typedef struct {
+  int trap;  /* R1 */
+  int arg;   /* R2 */
+  int arg2;  /* R3 */
+  int arg3;  /* R4 */
+} BATCH_OP;
+
+typedef struct {
+  BATCH_OP ops[MAX_BATCH];
+  int done;
+} BATCH_BUFFER;
+
+/* Returns a context's batch, which a BATCH trap reads its operations from */
+
+extern BATCH_BUFFER *kernel_batch(KERNEL_CONTEXT *context);
+
+/* Returns how many traps a context has taken and how many operations they
+   ran: one each, or for a BATCH trap as many as the batch ran. Every
+   operation over one per trap is a trap entry saved by batching. */
+
+extern void kernel_trap_stats(KERNEL_CONTEXT *context, unsigned long *traps,
+  unsigned long *operations);
+
+/* Sets how a context schedules processes: a SCHED_POLICY_ID from
+   scheduler.h, SCHED_MLFQ (the multilevel feedback queue) by default.
+   Normally done before the run starts; done mid-run, as after
+   kernel_restore(), the READY processes are moved to the new policy's
+   run queues. Setting the policy a context already has does nothing. */
+
+extern void kernel_set_scheduler(KERNEL_CONTEXT *context, int policy);
+
+/* Tunes a context's multilevel feedback queue (see MLFQ_CONFIG in
+   scheduler.h): quanta[level] ms of CPU time per quantum at each level,
+   lowest level first (NULL for QUANTUM at every level), a boost of every
+   process to the top level every boost_period ms (0 for none) and the
+   allotment of ms a process may use at a level before it drops (0 to drop
+   at the end of every quantum and rise on blocking early). Must be done
+   before the run starts. */
+
+extern void kernel_set_mlfq(KERNEL_CONTEXT *context, const int *quanta,
+  int boost_period, int allotment);
+
+/* Returns how many context switches (dispatches of a different process
+   than the CPU ran last) a context's CPUs made, and how many dispatches
+   came after the process had waited STARVATION_TIME ms or more READY */
+
+#define STARVATION_TIME 1000
+
+extern void kernel_sched_stats(KERNEL_CONTEXT *context, int *switches,
+  int *starved);
+
+/* Sets how a context schedules disk reads: a DISK_POLICY from disk.h,
+   DISK_PASSTHROUGH (every read straight to the driver) by default. Must
+   be done before the run starts. */
+
+extern void kernel_set_disk_policy(KERNEL_CONTEXT *context, int policy);
+
+/* Returns how many disk reads a context's processes made and how many
+   requests, after merging, went to the driver */
+
+extern void kernel_disk_stats(KERNEL_CONTEXT *context, int *reads,
+  int *requests);
+
+/* Tells a context whether its hardware puts an argument in R3 for every
+   trap that takes one. The supplied hardware only does for SEMAPHORE_OP
+   and leaves R3 as it was for the rest, so by default the kernel does not
+   read it for DISK_READ (the read's block is NO_BLOCK, see disk.h) or
+   FORK_PROGRAM (the new process gets DEFAULT_TICKETS). The traps only
+   other hardware models issue (DISK_READ_ASYNC and those after it) always
+   take their R3. */
+
+extern void kernel_set_full_registers(KERNEL_CONTEXT *context, BOOL full);
+
+/* What the kernel does when a process starts waiting on a semaphore
+   in a way that closes a cycle of processes waiting on each other (see
+   kernel.c). Cycles are ignored by default; the whole-system deadlock
+   check still ends the run once nothing at all can run. */
+
+typedef enum {
+  KERNEL_DEADLOCK_IGNORE,  /* do not look for cycles */
+  KERNEL_DEADLOCK_REPORT,  /* log each cycle and carry on */
+  KERNEL_DEADLOCK_STOP     /* also end the run at the first cycle that no
+                              other process can break */
+} KERNEL_DEADLOCK_MODE;
+
+extern void kernel_set_deadlock_detection(KERNEL_CONTEXT *context,
+  KERNEL_DEADLOCK_MODE mode);
+
+/* Returns how many deadlock cycles a context has found */
+
+extern int kernel_deadlocks(KERNEL_CONTEXT *context);
+
+/* Latency and fairness metrics (CPU, wait, response, turnaround and
+   blocked times per process, and wait and run times per priority level)
+   are kept as histograms and can be written, as CSV or as JSON, either at
+   any time or automatically when the run ends. */
+
+typedef enum {
+  KERNEL_METRICS_CSV,
+  KERNEL_METRICS_JSON
+} KERNEL_METRICS_FORMAT;
+
+extern void kernel_write_metrics(KERNEL_CONTEXT *context,
+  KERNEL_METRICS_FORMAT format, FILE *out);
+
+/* Makes the kernel write a context's metrics to file when the run ends
+   (NULL for not at all, the default) */
+
+extern void kernel_set_metrics(KERNEL_CONTEXT *context,
+  KERNEL_METRICS_FORMAT format, FILE *file);
+
+/* Checkpoints. kernel_save() writes the whole of a context's simulation
+   (process table, run queues, semaphores, disk queue, the running process's
+   quantum, counters and metrics) to a snapshot file; kernel_restore() puts
+   a snapshot in place of what a context held, installs the kernel's
+   interrupt handlers and lets the simulation carry on from there instead
+   of booting with initialize_kernel(). Where the restored context's output,
+   log and metrics go is left as they were set for it. Its scheduling
+   policy and MLFQ tuning can be changed after restoring, so that several
+   experiments can branch from one warmed-up state. The hardware's state
+   (clock, registers, pending I/O) is the hardware model's to save.
+
+   Both return FALSE if the file could not be written or read. A snapshot
+   is only restored by a kernel built the same way (NUMBER_OF_CPUS and so
+   on); otherwise, or if it is short, the context is left as it was. */
+
+extern BOOL kernel_save(KERNEL_CONTEXT *context, FILE *file);
+extern BOOL kernel_restore(KERNEL_CONTEXT *context, FILE *file);
+
+/* Returns how a context's simulation ended (or KERNEL_RUNNING) */
+
+extern KERNEL_RESULT kernel_result(KERNEL_CONTEXT *context);
+
+/* Frees a context and everything in it */
+
+extern void kernel_destroy(KERNEL_CONTEXT *context);
+
+/* Return how many CPUs the kernel was built for (NUMBER_OF_CPUS in
+   kernel.c), and select the CPU, from 0, that the registers belong to:
+   its running process (IDLE_PROCESS if none) is loaded into current_pid.
+   The CPUs run in parallel against the one clock, so a hardware model
+   with several runs each CPU's process and delivers traps and clock
+   interrupts on that CPU, selecting it first; an I/O interrupt can be
+   delivered on any of them. CPU 0 is selected when the kernel starts. */
+
+extern int kernel_cpu_count();
+extern void kernel_select_cpu(int cpu);
+
+/* Returns the earliest time at which the selected CPU needs a
+   CLOCK_INTERRUPT (the end of its running process's quantum, the next
+   tick at which the timer wheel has work or, if it is idle, now when
+   there is work for it), or NO_DEADLINE if it does not need one.
+   Clock interrupts before that time do nothing, so an event-driven
+   hardware model may skip them: it only has to deliver the
+   first clock interrupt at or after the deadline, and can otherwise
+   advance the clock straight to its next I/O completion or to the end
+   of the running processes' current bursts. The deadline changes
+   whenever an interrupt or trap is handled, on any CPU.
+
+   A CLOCK_TIME wraps after 2^32 ms (49.7 days), and a run has to end
+   before the clock does. The end of a sleep or of a timed DOWN is clamped
+   to LAST_TICK_TIME, the last clock tick before the wrap, and a deadline
+   that would come after it is NO_DEADLINE. */
+
+#define NO_DEADLINE ((CLOCK_TIME) -1)
+#define LAST_TICK_TIME \
+  (NO_DEADLINE / CLOCK_INTERRUPT_PERIOD * CLOCK_INTERRUPT_PERIOD)
+
+extern CLOCK_TIME kernel_next_deadline();
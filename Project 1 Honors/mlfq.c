@@ -0,0 +1,195 @@
+#include "hardware.h"
+#include "process_table.h"
+#include "scheduler.h"
+
+/* The multilevel feedback queue: a process runs from the highest
+   non-empty level, round robin within it, for its level's quantum at a
+   time. By default it drops a level every time it uses up its quantum and
+   rises one every time it blocks before then; with an allotment it drops
+   a level once it has used the allotment there, and only a boost brings
+   it back up (see MLFQ_CONFIG in scheduler.h). */
+
+// Returns TRUE if a boost has been due since time
+
+static BOOL boost_due(RUN_QUEUE *run_queue, CLOCK_TIME time)
+{
+  int period = run_queue->mlfq.config.boost_period;
+
+  return period && time / period != clock / period;
+}
+
+// Boosts every process on the run queue, if a boost has been due since it
+// was last looked at, by moving every level's queue onto the top level's
+
+static void boost_queue(RUN_QUEUE *run_queue)
+{
+  MLFQ_QUEUE *mlfq = &run_queue->mlfq;
+  PID_QUEUE *top = &mlfq->ready_queues[TOP_PRIORITY], *queue;
+  int level;
+
+  if (!boost_due(run_queue, mlfq->boosted))
+    return;
+  mlfq->boosted = clock;
+
+  for (level = TOP_PRIORITY - 1; level >= 0; level--)
+  {
+    queue = &mlfq->ready_queues[level];
+    if (queue->head == NO_PID)
+      continue;
+    process_links(queue->head)->prev = top->tail;
+    if (top->head == NO_PID)
+      top->head = queue->head;
+    else
+      process_links(top->tail)->next = queue->head;
+    top->tail = queue->tail;
+    queue->head = NO_PID;
+    queue->tail = NO_PID;
+  }
+  if (top->head != NO_PID)
+    mlfq->ready_levels = 1u << TOP_PRIORITY;
+}
+
+// Brings a process up to date with the run queue's boosts. Its priority
+// is only looked at through here, so one that was on a run queue when it
+// was boosted is in the top level's queue, as its priority now says.
+
+static void boost_process(RUN_QUEUE *run_queue, PID_type pid)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+
+  boost_queue(run_queue);
+  if (!boost_due(run_queue, sched->boosted))
+    return;
+  sched->boosted = clock;
+  process_hot(pid)->priority = TOP_PRIORITY;
+  sched->level_used = 0;
+}
+
+static void mlfq_init(RUN_QUEUE *run_queue)
+{
+  int level;
+
+  for (level = 0; level < NUMBER_OF_PRIORITY_LEVELS; level++)
+  {
+    run_queue->mlfq.ready_queues[level].head = NO_PID;
+    run_queue->mlfq.ready_queues[level].tail = NO_PID;
+  }
+  run_queue->mlfq.ready_levels = 0;
+  run_queue->mlfq.boosted = 0;
+}
+
+static void mlfq_destroy(RUN_QUEUE *run_queue)
+{
+}
+
+static void mlfq_on_wake(RUN_QUEUE *run_queue, PID_type pid)
+{
+}
+
+static void mlfq_enqueue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  PID_QUEUE *queue;
+  PROCESS_LINKS *links = process_links(pid);
+  int level;
+
+  boost_process(run_queue, pid);
+  level = process_hot(pid)->priority;
+  queue = &run_queue->mlfq.ready_queues[level];
+
+  links->next = NO_PID;
+  links->prev = queue->tail;
+  if (queue->head == NO_PID)
+    queue->head = pid;
+  else
+    process_links(queue->tail)->next = pid;
+  queue->tail = pid;
+  run_queue->mlfq.ready_levels |= 1u << level;
+}
+
+static PID_type mlfq_pick_next(RUN_QUEUE *run_queue)
+{
+  boost_queue(run_queue);
+
+  // The highest non-empty level is the highest set bit of the bitmap
+
+  if (!run_queue->mlfq.ready_levels)
+    return NO_PID;
+  return run_queue->mlfq.ready_queues[
+    31 - __builtin_clz(run_queue->mlfq.ready_levels)].head;
+}
+
+static void mlfq_dequeue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  PID_QUEUE *queue;
+  PROCESS_LINKS *links = process_links(pid);
+  int level;
+
+  boost_process(run_queue, pid);
+  level = process_hot(pid)->priority;
+  queue = &run_queue->mlfq.ready_queues[level];
+
+  if (links->prev == NO_PID)
+    queue->head = links->next;
+  else
+    process_links(links->prev)->next = links->next;
+  if (links->next == NO_PID)
+    queue->tail = links->prev;
+  else
+    process_links(links->next)->prev = links->prev;
+
+  if (queue->head == NO_PID)
+    run_queue->mlfq.ready_levels &= ~(1u << level);
+}
+
+static int mlfq_time_slice(RUN_QUEUE *run_queue, PID_type pid)
+{
+  return run_queue->mlfq.config.quanta[process_hot(pid)->priority];
+}
+
+// Drops a process a level
+
+static void demote(PID_type pid)
+{
+  if (process_hot(pid)->priority > 0)
+    process_hot(pid)->priority--;
+  process_sched(pid)->level_used = 0;
+}
+
+static void mlfq_tick(RUN_QUEUE *run_queue, PID_type pid, int ran,
+  BOOL expired)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+
+  boost_process(run_queue, pid);
+  if (!run_queue->mlfq.config.allotment)
+  {
+    if (expired)
+      demote(pid);
+    return;
+  }
+
+  sched->level_used += ran;
+  if (sched->level_used >= run_queue->mlfq.config.allotment)
+    demote(pid);
+}
+
+static void mlfq_on_block(RUN_QUEUE *run_queue, PID_type pid, BOOL early)
+{
+  if (!run_queue->mlfq.config.allotment && early &&
+    process_hot(pid)->priority < TOP_PRIORITY)
+    process_hot(pid)->priority++;
+}
+
+const SCHED_POLICY mlfq_policy = {
+  "mlfq",
+  FALSE,
+  mlfq_init,
+  mlfq_destroy,
+  mlfq_on_wake,
+  mlfq_enqueue,
+  mlfq_pick_next,
+  mlfq_dequeue,
+  mlfq_time_slice,
+  mlfq_tick,
+  mlfq_on_block
+};
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hardware.h"
+#include "process_table.h"
+#include "semaphore.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "group.h"
+#include "sync.h"
+
+__thread PROCESS_TABLE *process_table;
+
+// Unlink a page from the list of pages with unused entries
+
+static void unlink_free_page(int page_num)
+{
+  PROCESS_TABLE *table = process_table;
+  PROCESS_TABLE_PAGE *page = table->pages[page_num];
+
+  if (page->prev_page == NO_PID)
+    table->free_pages_head = page->next_page;
+  else
+    table->pages[page->prev_page]->next_page = page->next_page;
+  if (page->next_page != NO_PID)
+    table->pages[page->next_page]->prev_page = page->prev_page;
+}
+
+// Push a page on the front of the list of pages with unused entries
+
+static void link_free_page(int page_num)
+{
+  PROCESS_TABLE *table = process_table;
+  PROCESS_TABLE_PAGE *page = table->pages[page_num];
+
+  page->prev_page = NO_PID;
+  page->next_page = table->free_pages_head;
+  if (table->free_pages_head != NO_PID)
+    table->pages[table->free_pages_head]->prev_page = page_num;
+  table->free_pages_head = page_num;
+}
+
+// Make the directory cover at least page_num + 1 pages
+
+static void grow_directory(int page_num)
+{
+  PROCESS_TABLE *table = process_table;
+  int old_pages = table->page_count;
+  int i;
+
+  if (page_num < table->page_count)
+    return;
+
+  if (!table->page_count)
+    table->page_count = 1;
+  while (table->page_count <= page_num)
+    table->page_count *= 2;
+
+  table->pages = (PROCESS_TABLE_PAGE **) realloc(table->pages,
+    table->page_count * sizeof(PROCESS_TABLE_PAGE *));
+  table->empty_slots = (int *) realloc(table->empty_slots,
+    table->page_count * sizeof(int));
+  table->empty_slot_listed = (unsigned char *) realloc(table->empty_slot_listed,
+    table->page_count);
+  for (i = old_pages; i < table->page_count; i++)
+  {
+    table->pages[i] = NULL;
+    table->empty_slot_listed[i] = FALSE;
+  }
+}
+
+// Returns a directory slot with no page, preferring ones freed earlier
+
+static int empty_slot()
+{
+  PROCESS_TABLE *table = process_table;
+  int page_num;
+
+  while (table->empty_slots_top)
+  {
+    page_num = table->empty_slots[--table->empty_slots_top];
+    table->empty_slot_listed[page_num] = FALSE;
+    if (table->pages[page_num] == NULL)
+      return page_num;
+  }
+  while (table->next_fresh_page < table->page_count &&
+    table->pages[table->next_fresh_page] != NULL)
+    table->next_fresh_page++;
+  return table->next_fresh_page;
+}
+
+// Allocate the page for a directory slot, with all of its entries unused
+
+static void allocate_page(int page_num)
+{
+  PROCESS_TABLE *table = process_table;
+  PROCESS_TABLE_PAGE *page;
+  PID_type base = page_num << PROCESS_TABLE_PAGE_BITS;
+  int i;
+
+  grow_directory(page_num);
+  page = (PROCESS_TABLE_PAGE *) malloc(sizeof(PROCESS_TABLE_PAGE));
+  table->pages[page_num] = page;
+
+  // Thread every entry onto the page's free list, lowest PID first
+
+  for (i = 0; i < PROCESS_TABLE_PAGE_SIZE; i++)
+  {
+    page->hot[i].state = UNINITIALIZED;
+    page->links[i].next = (i + 1 < PROCESS_TABLE_PAGE_SIZE) ?
+      base + i + 1 : NO_PID;
+    page->links[i].prev = i ? base + i - 1 : NO_PID;
+  }
+  page->free_head = base;
+  page->live = 0;
+  link_free_page(page_num);
+}
+
+void process_table_init(PROCESS_TABLE *table)
+{
+  table->pages = NULL;
+  table->page_count = 0;
+  table->live = 0;
+  table->free_pages_head = NO_PID;
+  table->empty_slots = NULL;
+  table->empty_slots_top = 0;
+  table->empty_slot_listed = NULL;
+  table->next_fresh_page = 0;
+}
+
+void process_table_free(PROCESS_TABLE *table)
+{
+  int i;
+
+  for (i = 0; i < table->page_count; i++)
+    free(table->pages[i]);
+  free(table->pages);
+  free(table->empty_slots);
+  free(table->empty_slot_listed);
+  process_table_init(table);
+}
+
+BOOL process_exists(PID_type pid)
+{
+  PROCESS_TABLE *table = process_table;
+  int page_num = pid >> PROCESS_TABLE_PAGE_BITS;
+
+  return pid >= 0 && page_num < table->page_count &&
+    table->pages[page_num] != NULL &&
+    process_hot(pid)->state != UNINITIALIZED;
+}
+
+PID_type process_create(PID_type pid)
+{
+  PROCESS_TABLE *table = process_table;
+  PROCESS_TABLE_PAGE *page;
+  PROCESS_LINKS *links;
+  PROCESS_SCHED *sched;
+  PROCESS_COLD *cold;
+  int page_num, i;
+
+  if (pid > PROCESS_TABLE_MAX_PID || process_exists(pid))
+    return NO_PID;
+
+  if (pid < 0)
+  {
+    // Pick a page with an unused entry, making one if there is none
+
+    if (table->free_pages_head == NO_PID)
+    {
+      page_num = empty_slot();
+      if (page_num > PROCESS_TABLE_MAX_PID >> PROCESS_TABLE_PAGE_BITS)
+        return NO_PID;
+      allocate_page(page_num);
+    }
+    pid = table->pages[table->free_pages_head]->free_head;
+  }
+  else
+  {
+    page_num = pid >> PROCESS_TABLE_PAGE_BITS;
+    if (page_num >= table->page_count || table->pages[page_num] == NULL)
+      allocate_page(page_num);
+  }
+
+  // Take the entry off its page's free list
+
+  page_num = pid >> PROCESS_TABLE_PAGE_BITS;
+  page = table->pages[page_num];
+  links = process_links(pid);
+
+  if (links->prev == NO_PID)
+    page->free_head = links->next;
+  else
+    process_links(links->prev)->next = links->next;
+  if (links->next != NO_PID)
+    process_links(links->next)->prev = links->prev;
+
+  if (page->free_head == NO_PID)
+    unlink_free_page(page_num);
+  page->live++;
+  table->live++;
+
+  process_hot(pid)->state = READY;
+  process_hot(pid)->priority = 0;
+  process_hot(pid)->cpu = 0;
+  links->next = NO_PID;
+  links->prev = NO_PID;
+  sched = process_sched(pid);
+  sched->vruntime = 0;
+  sched->left = NO_PID;
+  sched->right = NO_PID;
+  sched->parent = NO_PID;
+  sched->red = FALSE;
+  sched->nice = 0;
+  sched->level_used = 0;
+  sched->boosted = clock;
+  sched->tickets = DEFAULT_TICKETS;
+  sched->heap_index = -1;
+  sched->group = ROOT_GROUP;
+  sched->rt_runtime = 0;
+  cold = process_cold(pid);
+  cold->total_CPU_time_used = 0;
+  cold->created_time = clock;
+  cold->first_run_time = -1;
+  cold->state_since = clock;
+  cold->wait_time = 0;
+  for (i = 0; i < NUMBER_OF_BLOCK_REASONS; i++)
+    cold->blocked_time[i] = 0;
+  cold->waiting_on = NO_SEMAPHORE;
+  cold->owned_head = NO_SEMAPHORE;
+  cold->deadlocked = FALSE;
+  cold->share_busy = 0;
+  cold->share_ticket_time = 0;
+  cold->async_pending = 0;
+  cold->async_completed = 0;
+  cold->async_wanted = 0;
+  cold->timer_slot = NO_TIMER;
+  cold->rwlocks_held = 0;
+  cold->sync_lock = NO_RWLOCK;
+  cold->sync_write = FALSE;
+  return pid;
+}
+
+void process_destroy(PID_type pid)
+{
+  PROCESS_TABLE *table = process_table;
+  int page_num = pid >> PROCESS_TABLE_PAGE_BITS;
+  PROCESS_TABLE_PAGE *page = table->pages[page_num];
+  PROCESS_LINKS *links = process_links(pid);
+
+  table->live--;
+
+  // Free the whole page once its last process is gone
+
+  if (!--page->live)
+  {
+    if (page->free_head != NO_PID)
+      unlink_free_page(page_num);
+    free(page);
+    table->pages[page_num] = NULL;
+    if (!table->empty_slot_listed[page_num])
+    {
+      table->empty_slot_listed[page_num] = TRUE;
+      table->empty_slots[table->empty_slots_top++] = page_num;
+    }
+    return;
+  }
+
+  // Otherwise put the entry back on the front of the page's free list
+
+  process_hot(pid)->state = UNINITIALIZED;
+  links->prev = NO_PID;
+  links->next = page->free_head;
+  if (page->free_head == NO_PID)
+    link_free_page(page_num);
+  else
+    process_links(page->free_head)->prev = pid;
+  page->free_head = pid;
+}
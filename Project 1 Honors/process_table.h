@@ -0,0 +1,269 @@
+
+/* The process table is a two level table indexed by PID, so that it can
+   grow to millions of processes while only using memory for the pages
+   that hold live processes:
+
+   PID bits 31..10: index into the page directory, process_table
+   PID bits  9..0 : index into a page of PROCESS_TABLE_PAGE_SIZE entries
+
+   A page is allocated the first time one of its PIDs is created and is
+   freed again once all of its processes have exited. The directory
+   doubles in size whenever a PID beyond its end is created, and is never
+   shrunk: it takes a pointer, an int and a byte for every page up to the
+   largest PID ever created, however few processes are live. PIDs are
+   therefore capped at PROCESS_TABLE_MAX_PID, which bounds the directory
+   at 16384 pages (208 KB with 8 byte pointers).
+
+   Every page keeps its unused entries on a free list, and the pages that
+   have unused entries are themselves kept on a list, so handing out a
+   fresh PID (and giving it back at exit) takes constant time.
+
+   Within a page the entries are split by how often they are touched:
+
+   hot  : state, priority and CPU, packed into 3 bytes, read and written
+          on every dispatch, clock interrupt and I/O interrupt
+   links: the queue links, touched on every enqueue/dequeue
+   sched: the scheduling policy's own state (see scheduler.h)
+   cold : accounting, touched once per change of state
+
+   so that scanning or updating the state of 100k+ processes streams
+   through 3 bytes per process instead of a whole entry. */
+
+#define PROCESS_TABLE_PAGE_BITS 10
+#define PROCESS_TABLE_PAGE_SIZE (1 << PROCESS_TABLE_PAGE_BITS)
+#define PROCESS_TABLE_PAGE_MASK (PROCESS_TABLE_PAGE_SIZE - 1)
+#define PROCESS_TABLE_MAX_PID ((1 << 24) - 1)
+
+// Marks the end of a list of PIDs (and "no process" in general)
+
+#define NO_PID -1
+
+typedef enum { RUNNING, READY, BLOCKED , UNINITIALIZED } PROCESS_STATE;
+
+// Queues are intrusive: a process is on at most one queue (ready or
+// semaphore) at a time, so the link to the next process lives in its
+// process table entry and queueing never allocates. NO_PID marks the end.
+
+typedef struct {
+  PID_type head;
+  PID_type tail;
+} PID_QUEUE;
+
+typedef struct {
+  unsigned char state;    // a PROCESS_STATE
+  unsigned char priority;
+  unsigned char cpu;      // CPU the process last ran (or was placed) on
+} PROCESS_HOT;
+
+typedef struct {
+  PID_type next; // next process on the same queue (or free list)
+  PID_type prev; // previous process on the free list (or any queue)
+} PROCESS_LINKS;
+
+typedef struct {
+  // CFS: virtual runtime, in 1/1024 ms of run time at weight 1024, and the
+  // links of the run queue's red-black tree. Stride keeps its pass in
+  // vruntime.
+
+  long long vruntime;
+  PID_type left;
+  PID_type right;
+  PID_type parent;
+  unsigned char red;
+
+  signed char nice;  // MIN_NICE..MAX_NICE, see SET_NICE in kernel.h
+
+  // MLFQ: time used at the current level (with an allotment) and when the
+  // process's priority was last brought up to date with boosts
+
+  int level_used;
+  CLOCK_TIME boosted;
+
+  // Stride and lottery: the process's tickets and where it is in its run
+  // queue's heap
+
+  int tickets;
+  int heap_index;
+
+  // The process's group (see group.h)
+
+  int group;
+
+  // Real-time (see realtime.h): the runtime (0 if the process is not
+  // real-time), relative deadline and period it declared, and its current
+  // job's start, deadline to meet, deadline it is scheduled by and budget
+  // left
+
+  int rt_runtime;
+  int rt_deadline;
+  int rt_period;
+  CLOCK_TIME rt_release;
+  CLOCK_TIME rt_job_deadline;
+  CLOCK_TIME rt_abs_deadline;
+  int rt_budget;
+} PROCESS_SCHED;
+
+// What a BLOCKED process is waiting for
+
+typedef enum {
+  BLOCKED_ON_DISK,
+  BLOCKED_ON_KEYBOARD,
+  BLOCKED_ON_SEMAPHORE,
+  BLOCKED_ON_TIMER,
+  BLOCKED_ON_QUOTA,
+  BLOCKED_ON_RWLOCK,
+  BLOCKED_ON_CONDVAR,
+  NUMBER_OF_BLOCK_REASONS
+} BLOCK_REASON;
+
+typedef struct {
+  int total_CPU_time_used;
+
+  // Latency accounting, all in clock time
+
+  int created_time;
+  int first_run_time;  // -1 until the process first runs
+  int state_since;     // when the process entered its current state
+  int wait_time;       // total time READY
+  int blocked_time[NUMBER_OF_BLOCK_REASONS];
+  unsigned char block_reason;  // a BLOCK_REASON, while BLOCKED
+
+  // Deadlock detection: the semaphore waited on while BLOCKED_ON_SEMAPHORE,
+  // the first semaphore the process owns (see semaphore.h) and whether it
+  // is in a deadlock that has been reported
+
+  int waiting_on;
+  int owned_head;
+  unsigned char deadlocked;
+
+  // Proportional share accounting (see report_shares in scheduler.h): the
+  // CPU time every process used, and that times the tickets of the
+  // processes competing for it, while this one was READY or RUNNING
+
+  long long share_busy;
+  long long share_ticket_time;
+
+  // Asynchronous disk reads (see DISK_READ_ASYNC in kernel.h): how many
+  // are outstanding, how many have finished and not been reaped, and how
+  // many finished ones the process waits for while blocked in DISK_WAIT
+
+  int async_pending;
+  int async_completed;
+  int async_wanted;
+
+  // The process's timer (see timer.h), set while it sleeps or waits on a
+  // semaphore with a timeout: its slot on the timer wheel (NO_TIMER if it
+  // has none), its neighbours there and the tick it expires at
+
+  int timer_slot;
+  PID_type timer_next;
+  PID_type timer_prev;
+  unsigned int timer_expires;
+
+  // Reader-writer locks (see sync.h): the locks the process holds, one
+  // bit per lock, the lock it waits for, or gave up to wait on a condition
+  // variable and will take back, and whether it wants it for writing
+
+  unsigned int rwlocks_held;
+  int sync_lock;
+  unsigned char sync_write;
+} PROCESS_COLD;
+
+typedef struct {
+  PROCESS_HOT hot[PROCESS_TABLE_PAGE_SIZE];
+  PROCESS_LINKS links[PROCESS_TABLE_PAGE_SIZE];
+  PROCESS_SCHED sched[PROCESS_TABLE_PAGE_SIZE];
+  PROCESS_COLD cold[PROCESS_TABLE_PAGE_SIZE];
+  int live;           // number of entries in use
+  PID_type free_head; // first unused entry on this page
+  int next_page;      // neighbours on the list of pages with unused entries
+  int prev_page;
+} PROCESS_TABLE_PAGE;
+
+typedef struct {
+  // The page directory; NULL for pages with no live process
+
+  PROCESS_TABLE_PAGE **pages;
+
+  // Number of pages the directory currently covers
+
+  int page_count;
+
+  // Number of processes currently in the table
+
+  int live;
+
+  // Head of the list of allocated pages that still have unused entries
+
+  int free_pages_head;
+
+  // Directory slots whose page was freed, handed out again before growing
+  // the directory. A slot can be refilled by creating one of its PIDs
+  // explicitly while it is still on the stack, so such slots are skipped
+  // when popping, and empty_slot_listed keeps a slot from being pushed
+  // twice.
+
+  int *empty_slots;
+  int empty_slots_top;
+  unsigned char *empty_slot_listed;
+
+  // Every directory slot below this one has had a page at some point
+
+  int next_fresh_page;
+} PROCESS_TABLE;
+
+// The table the functions below work on: the one belonging to the kernel
+// running on the calling thread (see kernel_select())
+
+extern __thread PROCESS_TABLE *process_table;
+
+// Return the hot, link, scheduling and cold parts of a process's entry.
+// The PID must have been created.
+
+static inline PROCESS_HOT *process_hot(PID_type pid)
+{
+  return &process_table->pages[pid >> PROCESS_TABLE_PAGE_BITS]->
+    hot[pid & PROCESS_TABLE_PAGE_MASK];
+}
+
+static inline PROCESS_LINKS *process_links(PID_type pid)
+{
+  return &process_table->pages[pid >> PROCESS_TABLE_PAGE_BITS]->
+    links[pid & PROCESS_TABLE_PAGE_MASK];
+}
+
+static inline PROCESS_SCHED *process_sched(PID_type pid)
+{
+  return &process_table->pages[pid >> PROCESS_TABLE_PAGE_BITS]->
+    sched[pid & PROCESS_TABLE_PAGE_MASK];
+}
+
+static inline PROCESS_COLD *process_cold(PID_type pid)
+{
+  return &process_table->pages[pid >> PROCESS_TABLE_PAGE_BITS]->
+    cold[pid & PROCESS_TABLE_PAGE_MASK];
+}
+
+// Sets up an empty table
+
+void process_table_init(PROCESS_TABLE *table);
+
+// Frees every page of a table (and its directory)
+
+void process_table_free(PROCESS_TABLE *table);
+
+// Returns TRUE if the PID is currently in use by a process
+
+BOOL process_exists(PID_type pid);
+
+// Creates a process table entry (READY since now, priority 0, nice 0,
+// DEFAULT_TICKETS, CPU 0, the root group, not real-time, no CPU time used)
+// and returns its PID. If pid is NO_PID, or is negative, an unused PID is
+// allocated instead. Returns NO_PID, creating nothing, if pid is already in
+// use or above PROCESS_TABLE_MAX_PID, or if every PID is in use.
+
+PID_type process_create(PID_type pid);
+
+// Releases the entry of an exited process so its PID can be reused
+
+void process_destroy(PID_type pid);
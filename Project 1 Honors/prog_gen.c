@@ -0,0 +1,436 @@
+/* Writes a random trace in the format of processes.dat (see simulator.c),
+   as prog.py does, but quickly enough for traces of millions of events
+   and thousands of processes:
+
+   make prog_gen
+   ./prog_gen [-n processes] [-i initial processes] [-l events]
+              [-r run ms] [-k disk read size] [-m semaphore]
+              [-p probabilities]... [-s seed] [-o trace file]
+
+   Process 0 forks processes 1 to the number of initial ones (2). Then
+   every process, in the order they were forked, gets its events: each one
+   is a run, diskread, keyboardread, diskwrite, down, up or fork, picked
+   with the cumulative probabilities of the process's class, class pid %
+   number of classes. -p adds a class; its seven cumulative probabilities,
+   in that order of events and comma separated, must grow to 1. Without
+   -p the classes are prog.py's events_prob. A fork creates the next
+   unused PID below the number of processes given with -n (10); when
+   there is none left it becomes a run. Unlike prog.py, every process
+   forked gets its events, however many PIDs are left.
+
+   -l, -r, -k and -m are distributions of the number of events of a
+   process (15), and of the arguments of run (10,100,20), diskread
+   (10,30,10) and down and up (0,3,1):
+
+   n                       always n
+   lo,hi[,step]            uniform over lo, lo + step, ... below hi, as
+                           Python's random.randrange(lo, hi, step)
+   exp:mean[,lo[,hi]]      exponential with that mean, rounded and kept
+                           within lo (1) and hi
+   zipf:n[,s]              0..n - 1, k with probability proportional to
+                           1 / (k + 1)^s (s = 1), so low numbers are hot
+
+   The numbers come from xoshiro256**, seeded through splitmix64 with -s
+   or, by default, the time of day; the seed is reported on stderr so the
+   trace can be made again. Lines are formatted by hand into a large
+   buffer that is written out whenever it fills, to standard output if
+   the trace file is -. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+typedef enum { RUN, DISKREAD, KEYBOARDREAD, DISKWRITE, DOWN, UP, FORK,
+  NUMBER_OF_OPS } OP;
+
+static const char *names[NUMBER_OF_OPS] = { "run", "diskread",
+  "keyboardread", "diskwrite", "down", "up", "fork" };
+
+// prog.py's events_prob
+
+static const double default_classes[][NUMBER_OF_OPS] = {
+  { 0.3, 0.6, 0.8, 0.85, 0.9, 0.95, 1 },
+  { 0.6, 0.7, 0.8, 0.85, 0.9, 0.95, 1 },
+  { 0.5, 0.6, 0.7, 0.8, 0.9, 1, 1 }
+};
+
+typedef enum { CONSTANT, UNIFORM, EXPONENTIAL, ZIPF } DISTRIBUTION_KIND;
+
+typedef struct {
+  DISTRIBUTION_KIND kind;
+
+  // Uniform: lo, lo + step, ... below hi; constant: lo; exponential: the
+  // mean, kept within lo..hi
+
+  long lo;
+  long hi;
+  long step;
+  double mean;
+
+  // Zipf: cumulative probabilities of 0..n - 1
+
+  double *cdf;
+  int n;
+} DISTRIBUTION;
+
+// xoshiro256** state
+
+static unsigned long long state[4];
+
+static unsigned long long splitmix64(unsigned long long *x)
+{
+  unsigned long long z = (*x += 0x9E3779B97F4A7C15ULL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static unsigned long long rotl(unsigned long long x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+static unsigned long long next_random()
+{
+  unsigned long long result = rotl(state[1] * 5, 7) * 9;
+  unsigned long long t = state[1] << 17;
+
+  state[2] ^= state[0];
+  state[3] ^= state[1];
+  state[1] ^= state[2];
+  state[0] ^= state[3];
+  state[2] ^= t;
+  state[3] = rotl(state[3], 45);
+  return result;
+}
+
+static void seed_random(unsigned long long seed)
+{
+  int i;
+
+  for (i = 0; i < 4; i++)
+    state[i] = splitmix64(&seed);
+}
+
+// Returns a number in [0, 1)
+
+static double random_fraction()
+{
+  return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Returns a number below n, for n up to 2^32
+
+static long random_below(unsigned long long n)
+{
+  return (long) (((next_random() >> 32) * n) >> 32);
+}
+
+// Parses a distribution (see the top of the file); returns 0 if it is not
+// one
+
+static int parse_distribution(const char *text, DISTRIBUTION *dist)
+{
+  double s = 1, sum = 0;
+  int k, fields;
+  char extra;
+
+  memset(dist, 0, sizeof(*dist));
+  if (!strncmp(text, "exp:", 4))
+  {
+    dist->kind = EXPONENTIAL;
+    dist->lo = 1;
+    dist->hi = 0x7FFFFFFF;
+    fields = sscanf(text + 4, "%lf,%ld,%ld%c", &dist->mean, &dist->lo,
+      &dist->hi, &extra);
+    return fields >= 1 && fields <= 3 && dist->mean > 0 &&
+      dist->lo <= dist->hi;
+  }
+  if (!strncmp(text, "zipf:", 5))
+  {
+    dist->kind = ZIPF;
+    fields = sscanf(text + 5, "%d,%lf%c", &dist->n, &s, &extra);
+    if (fields < 1 || fields > 2 || dist->n <= 0 || s < 0)
+      return 0;
+    dist->cdf = (double *) malloc(dist->n * sizeof(double));
+    for (k = 0; k < dist->n; k++)
+      dist->cdf[k] = sum += pow(k + 1, -s);
+    for (k = 0; k < dist->n; k++)
+      dist->cdf[k] /= sum;
+    return 1;
+  }
+
+  dist->step = 1;
+  fields = sscanf(text, "%ld,%ld,%ld%c", &dist->lo, &dist->hi, &dist->step,
+    &extra);
+  if (fields == 1)
+  {
+    dist->kind = CONSTANT;
+    return 1;
+  }
+  dist->kind = UNIFORM;
+  return (fields == 2 || fields == 3) && dist->step > 0 &&
+    dist->hi > dist->lo && (dist->hi - dist->lo) / dist->step < 0xFFFFFFFFL;
+}
+
+static long sample(DISTRIBUTION *dist)
+{
+  double u;
+  long value;
+  int low, high, middle;
+
+  switch (dist->kind)
+  {
+  case CONSTANT:
+    return dist->lo;
+  case UNIFORM:
+    return dist->lo + dist->step *
+      random_below((dist->hi - dist->lo + dist->step - 1) / dist->step);
+  case EXPONENTIAL:
+    value = (long) (-dist->mean * log(1 - random_fraction()) + 0.5);
+    return value < dist->lo ? dist->lo : value > dist->hi ? dist->hi : value;
+  case ZIPF:
+    // The first k whose cumulative probability is above u
+
+    u = random_fraction();
+    low = 0;
+    high = dist->n - 1;
+    while (low < high)
+    {
+      middle = (low + high) / 2;
+      if (dist->cdf[middle] > u)
+        high = middle;
+      else
+        low = middle + 1;
+    }
+    return low;
+  }
+  return 0;
+}
+
+// Parses a class's cumulative probabilities into probabilities; returns 0
+// if they are not seven growing probabilities ending in 1
+
+static int parse_class(const char *text, double *probabilities)
+{
+  char *end;
+  int op;
+
+  for (op = 0; op < NUMBER_OF_OPS; op++)
+  {
+    probabilities[op] = strtod(text, &end);
+    if (end == text || probabilities[op] < (op ? probabilities[op - 1] : 0) ||
+      *end != (op < NUMBER_OF_OPS - 1 ? ',' : '\0'))
+      return 0;
+    text = end + 1;
+  }
+  return probabilities[NUMBER_OF_OPS - 1] == 1;
+}
+
+// Output is formatted into buffer and written out when it fills up
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define LONGEST_LINE 64
+
+static char buffer[OUTPUT_BUFFER_SIZE];
+static size_t buffered;
+static FILE *out;
+
+static void flush_output()
+{
+  fwrite(buffer, 1, buffered, out);
+  buffered = 0;
+}
+
+static void put_number(long value)
+{
+  char digits[24];
+  int count = 0;
+  unsigned long magnitude = value < 0 ? -(unsigned long) value :
+    (unsigned long) value;
+
+  if (value < 0)
+    buffer[buffered++] = '-';
+  do
+  {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  while (count)
+    buffer[buffered++] = digits[--count];
+}
+
+static void put_event(int pid, OP op, long arg)
+{
+  const char *name = names[op];
+
+  if (buffered > OUTPUT_BUFFER_SIZE - LONGEST_LINE)
+    flush_output();
+  put_number(pid);
+  buffer[buffered++] = ' ';
+  while (*name)
+    buffer[buffered++] = *name++;
+  if (op != KEYBOARDREAD && op != DISKWRITE)
+  {
+    buffer[buffered++] = ' ';
+    put_number(arg);
+  }
+  buffer[buffered++] = '\n';
+}
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+  int processes = 10, initial = 2, class_count = 0, next_pid, head, tail;
+  int arg = 1, pid, op;
+  long event, length;
+  unsigned long events = 0;
+  unsigned long long seed;
+  double (*classes)[NUMBER_OF_OPS] = NULL, *probabilities, u, start;
+  DISTRIBUTION lengths, runs, disk_sizes, semaphores;
+  const char *path = "processes.dat";
+  int *queue;
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  seed = (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+  parse_distribution("15", &lengths);
+  parse_distribution("10,100,20", &runs);
+  parse_distribution("10,30,10", &disk_sizes);
+  parse_distribution("0,3,1", &semaphores);
+
+  for (; arg < argc && argv[arg][0] == '-'; arg++)
+  {
+    if (arg + 1 < argc && !strcmp(argv[arg], "-n") &&
+      sscanf(argv[arg + 1], "%d", &processes) == 1 && processes > 1)
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-i") &&
+      sscanf(argv[arg + 1], "%d", &initial) == 1 && initial > 0)
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-l") &&
+      parse_distribution(argv[arg + 1], &lengths))
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-r") &&
+      parse_distribution(argv[arg + 1], &runs))
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-k") &&
+      parse_distribution(argv[arg + 1], &disk_sizes))
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-m") &&
+      parse_distribution(argv[arg + 1], &semaphores))
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-p"))
+    {
+      classes = (double (*)[NUMBER_OF_OPS]) realloc(classes,
+        (class_count + 1) * sizeof(*classes));
+      if (!parse_class(argv[++arg], classes[class_count++]))
+      {
+        fprintf(stderr, "bad probabilities %s\n", argv[arg]);
+        return 1;
+      }
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-s") &&
+      sscanf(argv[arg + 1], "%llu", &seed) == 1)
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-o"))
+      path = argv[++arg];
+    else
+    {
+      fprintf(stderr, "usage: %s [-n processes] [-i initial processes] "
+        "[-l events] [-r run ms] [-k disk read size] [-m semaphore] "
+        "[-p probabilities]... [-s seed] [-o trace file]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (initial >= processes)
+  {
+    fprintf(stderr, "%d processes leave no room for %d initial ones\n",
+      processes, initial);
+    return 1;
+  }
+  if (!class_count)
+  {
+    classes = (double (*)[NUMBER_OF_OPS]) default_classes;
+    class_count = sizeof(default_classes) / sizeof(default_classes[0]);
+  }
+
+  out = strcmp(path, "-") ? fopen(path, "w") : stdout;
+  if (out == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+  seed_random(seed);
+  start = now();
+
+  // Processes get their events in the order they were forked, as prog.py's
+  // deque of PIDs; every PID goes through queue once
+
+  queue = (int *) malloc(processes * sizeof(int));
+  head = 0;
+  tail = 0;
+  for (next_pid = 1; next_pid <= initial; next_pid++)
+  {
+    put_event(0, FORK, next_pid);
+    queue[tail++] = next_pid;
+  }
+  events = initial;
+
+  while (head < tail)
+  {
+    pid = queue[head++];
+    probabilities = classes[pid % class_count];
+    length = sample(&lengths);
+    for (event = 0; event < length; event++)
+    {
+      u = random_fraction();
+      for (op = 0; u > probabilities[op]; op++)
+        ;
+
+      // A fork with no PID left becomes a run
+
+      if (op == FORK && next_pid == processes)
+        op = RUN;
+      switch (op)
+      {
+      case FORK:
+        put_event(pid, FORK, next_pid);
+        queue[tail++] = next_pid++;
+        break;
+      case RUN:
+        put_event(pid, RUN, sample(&runs));
+        break;
+      case DISKREAD:
+        put_event(pid, DISKREAD, sample(&disk_sizes));
+        break;
+      case DOWN:
+      case UP:
+        put_event(pid, op, sample(&semaphores));
+        break;
+      default:
+        put_event(pid, op, 0);
+      }
+    }
+    events += length;
+  }
+  flush_output();
+
+  if (fflush(out) || ferror(out) || (out != stdout && fclose(out)))
+  {
+    perror(path);
+    return 1;
+  }
+  fprintf(stderr, "%lu events for %d processes in %.3f s (seed %llu)\n",
+    events, tail + 1, now() - start, seed);
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+
+#include "hardware.h"
+#include "process_table.h"
+#include "realtime.h"
+
+// A process's density
+
+static long long density(PID_type pid)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+
+  return sched->rt_runtime * RT_UNIT / sched->rt_deadline;
+}
+
+void realtime_init(REALTIME_CLASS *rt, int cpus)
+{
+  rt->heap = NULL;
+  rt->count = 0;
+  rt->capacity = 0;
+  rt->utilization = 0;
+  rt->limit = cpus * RT_UNIT * RT_UTILIZATION_LIMIT / 100;
+  rt->jobs = 0;
+  rt->misses = 0;
+}
+
+void realtime_free(REALTIME_CLASS *rt)
+{
+  free(rt->heap);
+  rt->heap = NULL;
+  rt->count = 0;
+  rt->capacity = 0;
+}
+
+long long realtime_fits(REALTIME_CLASS *rt, PID_type pid, int runtime,
+  int deadline)
+{
+  long long utilization = rt->utilization + runtime * RT_UNIT / deadline;
+
+  if (realtime(pid))
+    utilization -= density(pid);
+  return utilization <= rt->limit ? utilization : -1;
+}
+
+void realtime_admit(REALTIME_CLASS *rt, PID_type pid, int runtime,
+  int deadline, int period)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+
+  if (realtime(pid))
+    rt->utilization -= density(pid);
+  sched->rt_runtime = runtime;
+  sched->rt_deadline = deadline;
+  sched->rt_period = period;
+  rt->utilization += density(pid);
+
+  sched->rt_release = clock;
+  sched->rt_job_deadline = clock + deadline;
+  sched->rt_abs_deadline = sched->rt_job_deadline;
+  sched->rt_budget = runtime;
+}
+
+void realtime_leave(REALTIME_CLASS *rt, PID_type pid)
+{
+  rt->utilization -= density(pid);
+  process_sched(pid)->rt_runtime = 0;
+}
+
+void realtime_start_job(PID_type pid)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+
+  if (clock < sched->rt_release + sched->rt_period)
+    sched->rt_release += sched->rt_period;
+  else
+    sched->rt_release = clock;
+  sched->rt_job_deadline = sched->rt_release + sched->rt_deadline;
+  sched->rt_abs_deadline = sched->rt_job_deadline;
+  sched->rt_budget = sched->rt_runtime;
+}
+
+void realtime_charge(PID_type pid, int ran)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+
+  sched->rt_budget -= ran;
+}
+
+BOOL realtime_refill(PID_type pid)
+{
+  PROCESS_SCHED *sched = process_sched(pid);
+
+  while (sched->rt_budget <= 0 && sched->rt_abs_deadline <= clock)
+  {
+    sched->rt_budget += sched->rt_runtime;
+    sched->rt_abs_deadline += sched->rt_period;
+  }
+  return sched->rt_budget > 0;
+}
+
+int realtime_end_job(REALTIME_CLASS *rt, PID_type pid)
+{
+  CLOCK_TIME deadline = process_sched(pid)->rt_job_deadline;
+
+  rt->jobs++;
+  if (clock <= deadline)
+    return 0;
+  rt->misses++;
+  return clock - deadline;
+}
+
+// Heap order: deadline, then PID so that ties go the same way every run
+
+static BOOL before(PID_type a, PID_type b)
+{
+  PROCESS_SCHED *sa = process_sched(a), *sb = process_sched(b);
+
+  return sa->rt_abs_deadline < sb->rt_abs_deadline ||
+    (sa->rt_abs_deadline == sb->rt_abs_deadline && a < b);
+}
+
+void realtime_push(REALTIME_CLASS *rt, PID_type pid)
+{
+  int i;
+
+  if (rt->count == rt->capacity)
+  {
+    rt->capacity = rt->capacity ? rt->capacity * 2 : 64;
+    rt->heap = (PID_type *) realloc(rt->heap,
+      rt->capacity * sizeof(PID_type));
+  }
+
+  for (i = rt->count++; i > 0 && before(pid, rt->heap[(i - 1) / 2]);
+    i = (i - 1) / 2)
+    rt->heap[i] = rt->heap[(i - 1) / 2];
+  rt->heap[i] = pid;
+}
+
+PID_type realtime_pop(REALTIME_CLASS *rt)
+{
+  PID_type first, last;
+  int i = 0, child;
+
+  if (!rt->count)
+    return NO_PID;
+
+  first = rt->heap[0];
+  last = rt->heap[--rt->count];
+  while ((child = 2 * i + 1) < rt->count)
+  {
+    if (child + 1 < rt->count && before(rt->heap[child + 1], rt->heap[child]))
+      child++;
+    if (!before(rt->heap[child], last))
+      break;
+    rt->heap[i] = rt->heap[child];
+    i = child;
+  }
+  if (rt->count)
+    rt->heap[i] = last;
+  return first;
+}
@@ -0,0 +1,113 @@
+
+/* The real-time class (see SET_REALTIME in kernel.h), which runs before
+   any scheduling policy: whenever a real-time process is READY, the
+   kernel runs the one with the earliest deadline (EDF), on whichever CPU
+   looks for work first.
+
+   A real-time process declares a runtime, a relative deadline and a
+   period, and runs as a series of jobs. A job starts when the process
+   becomes READY after being admitted or blocked, no sooner than a period
+   after the previous job started (an early wake-up only sets the job's
+   deadline as if it had started then), and ends when the process blocks
+   or exits. It must finish by its start plus the deadline, and may use up
+   to the runtime in that time. A job that uses up its budget is throttled
+   until its deadline, when the budget is refilled with the next period's
+   runtime and the deadline moved a period later (a hard constant
+   bandwidth server); one that is already late gets the next period's
+   budget at once. Either way an overrunning process gets no more than
+   its share, so it cannot take time from the other real-time processes
+   or starve the ordinary ones. The deadline it has to meet stays the
+   first one.
+
+   Admission control keeps the total density (runtime / deadline) of the
+   real-time processes at most RT_UTILIZATION_LIMIT percent of the CPUs,
+   leaving the rest for everyone else; beyond that EDF cannot promise to
+   meet every deadline. Deadlines are only checked at clock interrupts, so
+   they can be missed by up to CLOCK_INTERRUPT_PERIOD ms even so.
+
+   The READY real-time processes are a binary min-heap on deadline (then
+   PID), so waking and dispatching one take O(log n). */
+
+#define RT_UTILIZATION_LIMIT 95
+
+// Densities are fixed point fractions of a CPU
+
+#define RT_UNIT (1LL << 20)
+
+typedef struct {
+  PID_type *heap;
+  int count;
+  int capacity;
+
+  // The total density of the real-time processes, and the most allowed
+
+  long long utilization;
+  long long limit;
+
+  // Jobs ended, and how many of those missed their deadline
+
+  int jobs;
+  int misses;
+} REALTIME_CLASS;
+
+// Sets up an empty class for that many CPUs
+
+void realtime_init(REALTIME_CLASS *rt, int cpus);
+
+// Frees a class's heap
+
+void realtime_free(REALTIME_CLASS *rt);
+
+// Returns the class's total density if a process were given the runtime
+// and deadline (giving up whatever it has already), or -1 if that is over
+// the limit
+
+long long realtime_fits(REALTIME_CLASS *rt, PID_type pid, int runtime,
+  int deadline);
+
+// Makes a process real-time (or changes what it declared), its first job
+// starting now; it must fit
+
+void realtime_admit(REALTIME_CLASS *rt, PID_type pid, int runtime,
+  int deadline, int period);
+
+// Takes a real-time process out of the class (when it leaves or exits)
+
+void realtime_leave(REALTIME_CLASS *rt, PID_type pid);
+
+// Starts a new job of a process that becomes READY after blocking
+
+void realtime_start_job(PID_type pid);
+
+// Takes ran ms off the running job's budget
+
+void realtime_charge(PID_type pid, int ran);
+
+// Refills a job's used up budget, moving its deadline back a period, as
+// often as the deadline has passed. Returns TRUE if the job has budget
+// left; otherwise it must be throttled until its deadline.
+
+BOOL realtime_refill(PID_type pid);
+
+// Ends the running job, counting it, and returns how many ms after its
+// deadline it ended (0 if it was in time)
+
+int realtime_end_job(REALTIME_CLASS *rt, PID_type pid);
+
+// Put a READY process on the heap, take the one with the earliest
+// deadline off it, and return that one (NO_PID if there are none)
+
+void realtime_push(REALTIME_CLASS *rt, PID_type pid);
+PID_type realtime_pop(REALTIME_CLASS *rt);
+
+static inline PID_type realtime_first(REALTIME_CLASS *rt)
+{
+  return rt->count ? rt->heap[0] : NO_PID;
+}
+
+// Returns TRUE if a process is real-time
+
+static inline BOOL realtime(PID_type pid)
+{
+  return process_sched(pid)->rt_runtime > 0;
+}
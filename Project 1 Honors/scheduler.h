@@ -0,0 +1,187 @@
+/* Scheduling policies. A policy decides which READY process a CPU runs
+   next and for how long; the kernel keeps everything else (process
+   states, CPUs, I/O, accounting). A context uses one policy, chosen before
+   the run starts (see kernel_set_scheduler() in kernel.h), and every CPU
+   has its own RUN_QUEUE of the processes that are READY to run on it.
+
+   The kernel calls a policy's hooks as follows:
+
+   init      : on every run queue, when the policy is chosen
+   destroy   : on every run queue, when the policy is replaced or the
+               context destroyed
+   on_wake   : a process was forked, its wait ended or it moved to another
+               CPU, just before it goes on (or, stolen, runs from) run_queue
+   enqueue   : a process became READY on run_queue
+   pick_next : which process run_queue should run next (NO_PID if it is
+               empty); it stays on the queue
+   dequeue   : take a READY process off run_queue, to run it
+   time_slice: how long a process just taken off run_queue may run before
+               a clock interrupt preempts it
+   tick      : the running process is charged for ran ms of CPU time on
+               run_queue's CPU, at the end of its time slice (expired) or
+               when it blocks or exits
+   on_block  : the running process blocked, before its time slice ended
+               if early
+
+   Policies keep their per-process state in the process table (priority
+   in PROCESS_HOT, the rest in PROCESS_SCHED). A policy that shares the
+   CPU out by tickets has report_shares set, and the kernel then reports
+   each process's achieved and requested share when it exits. */
+
+/* Number of priority levels (and ready queues) of the multilevel feedback
+   queue. Level NUMBER_OF_PRIORITY_LEVELS - 1 is the highest priority. It can
+   be overridden at compile time, e.g. -DNUMBER_OF_PRIORITY_LEVELS=8, up to
+   one level per bit of ready_levels. */
+
+#ifndef NUMBER_OF_PRIORITY_LEVELS
+#define NUMBER_OF_PRIORITY_LEVELS 5
+#endif
+
+#if NUMBER_OF_PRIORITY_LEVELS < 1 || NUMBER_OF_PRIORITY_LEVELS > 32
+#error "NUMBER_OF_PRIORITY_LEVELS must be between 1 and 32"
+#endif
+
+#define TOP_PRIORITY (NUMBER_OF_PRIORITY_LEVELS - 1)
+
+/* A quantum is 40 ms, by default at every level of the MLFQ */
+
+#define QUANTUM 40
+
+/* CFS gives each of the n processes on a run queue a share of
+   CFS_LATENCY proportional to its weight as its time slice, but never less
+   than CFS_MIN_GRANULARITY. A process that wakes up is placed at most
+   CFS_WAKEUP_CREDIT ms of (weight 1024) run time behind the run queue's
+   minimum virtual runtime, so sleeping does not bank CPU time. */
+
+#define CFS_LATENCY 80
+#define CFS_MIN_GRANULARITY 10
+#define CFS_WAKEUP_CREDIT (CFS_LATENCY / 2)
+
+/* Nice values, set with the SET_NICE trap (see kernel.h), weigh a
+   process's share under CFS as in Linux: each step is about 10% of CPU
+   time, nice 0 weighs 1024. MLFQ ignores them. */
+
+#define MIN_NICE -20
+#define MAX_NICE 19
+
+/* Stride and lottery scheduling share the CPU out in proportion to
+   tickets: DEFAULT_TICKETS per process unless it was given some when it
+   was forked (see FORK_PROGRAM in kernel.h), at most MAX_TICKETS. Both
+   run a process for QUANTUM ms at a time. */
+
+#define DEFAULT_TICKETS 100
+#define MAX_TICKETS 65536
+
+typedef enum {
+  SCHED_MLFQ,     /* multilevel feedback queue (the default) */
+  SCHED_CFS,      /* completely fair: lowest weighted virtual runtime first */
+  SCHED_STRIDE,   /* stride: lowest pass first, pass advancing by 1/tickets */
+  SCHED_LOTTERY,  /* lottery: a random ticket picks the process */
+  NUMBER_OF_SCHED_POLICIES
+} SCHED_POLICY_ID;
+
+/* How the MLFQ behaves, set by the kernel (see kernel_set_mlfq() in
+   kernel.h). By default it follows the classic rules: a quantum of
+   QUANTUM at every level, a level down whenever a process uses up its
+   quantum and a level up whenever it blocks before then, and no boost.
+
+   quanta[level] : ms a process runs at a level before it is preempted
+   boost_period  : every boost_period ms (0 for never) every process goes
+                   back to the top level, so none starves for good
+   allotment     : if not 0, a process drops a level once it has used
+                   allotment ms there, however many quanta that took and
+                   whether or not it blocked in between, and it only rises
+                   again when boosted, so blocking just before the end of
+                   every quantum no longer keeps it at the top */
+
+typedef struct {
+  int quanta[NUMBER_OF_PRIORITY_LEVELS];
+  int boost_period;
+  int allotment;
+} MLFQ_CONFIG;
+
+typedef struct {
+  MLFQ_CONFIG config;
+
+  // The multilevel feedback queue. Queues are doubly linked through the
+  // process table, so any READY process can be taken off in constant time.
+
+  PID_QUEUE ready_queues[NUMBER_OF_PRIORITY_LEVELS];
+
+  // Bitmap of non-empty ready queues: bit i is set iff ready_queues[i] has
+  // a process in it. Only READY processes are ever put in a ready queue, so
+  // the highest set bit is always the level to dispatch from.
+
+  unsigned int ready_levels;
+
+  // Boosts are applied lazily: a run queue, or a process, last brought up
+  // to date (at this time) before the latest multiple of boost_period is
+  // boosted the next time the policy looks at it
+
+  CLOCK_TIME boosted;
+} MLFQ_QUEUE;
+
+typedef struct {
+  // Red-black tree of READY processes ordered by virtual runtime (then
+  // PID), linked through PROCESS_SCHED, and its leftmost process
+
+  PID_type root;
+  PID_type leftmost;
+
+  // Never decreases; where woken processes are placed from
+
+  long long min_vruntime;
+
+  // Total weight of the processes in the tree
+
+  int weight;
+} CFS_QUEUE;
+
+typedef struct {
+  // The READY processes as a complete binary tree in an array, linked to
+  // from PROCESS_SCHED's heap_index. For stride it is a min-heap on pass
+  // (then PID); for lottery the order does not matter and tickets[i] is
+  // the number of tickets in the subtree rooted at i.
+
+  PID_type *heap;
+  long long *tickets;
+  int count;
+  int capacity;
+
+  // Stride: never decreases; where woken processes are placed from
+
+  long long min_pass;
+
+  // Lottery: state of the random number generator that draws tickets
+
+  unsigned long long seed;
+} STRIDE_QUEUE;
+
+typedef struct {
+  MLFQ_QUEUE mlfq;
+  CFS_QUEUE cfs;
+  STRIDE_QUEUE stride;
+
+  // Number of processes in the run queue, kept by the kernel
+
+  int ready_count;
+} RUN_QUEUE;
+
+typedef struct {
+  const char *name;
+  BOOL report_shares;
+  void (*init)(RUN_QUEUE *run_queue);
+  void (*destroy)(RUN_QUEUE *run_queue);
+  void (*on_wake)(RUN_QUEUE *run_queue, PID_type pid);
+  void (*enqueue)(RUN_QUEUE *run_queue, PID_type pid);
+  PID_type (*pick_next)(RUN_QUEUE *run_queue);
+  void (*dequeue)(RUN_QUEUE *run_queue, PID_type pid);
+  int (*time_slice)(RUN_QUEUE *run_queue, PID_type pid);
+  void (*tick)(RUN_QUEUE *run_queue, PID_type pid, int ran, BOOL expired);
+  void (*on_block)(RUN_QUEUE *run_queue, PID_type pid, BOOL early);
+} SCHED_POLICY;
+
+extern const SCHED_POLICY mlfq_policy;
+extern const SCHED_POLICY cfs_policy;
+extern const SCHED_POLICY stride_policy;
+extern const SCHED_POLICY lottery_policy;
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+
+#include "hardware.h"
+#include "process_table.h"
+#include "semaphore.h"
+
+void semaphore_table_init(SEMAPHORE_TABLE *table, int capacity, int open,
+  int value)
+{
+  int id;
+
+  table->semaphores = (SEMAPHORE *) malloc(capacity * sizeof(SEMAPHORE));
+  table->capacity = capacity;
+  table->free_head = NO_SEMAPHORE;
+
+  // Closed semaphores are pushed from the top so the lowest IDs are handed
+  // out first
+
+  for (id = capacity - 1; id >= 0; id--)
+  {
+    table->semaphores[id].ready_queue.head = NO_PID;
+    table->semaphores[id].ready_queue.tail = NO_PID;
+    table->semaphores[id].value = value;
+    table->semaphores[id].open = id < open;
+    table->semaphores[id].next_free = NO_SEMAPHORE;
+    table->semaphores[id].owner = NO_PID;
+    table->semaphores[id].owned_next = NO_SEMAPHORE;
+    table->semaphores[id].owned_prev = NO_SEMAPHORE;
+    table->semaphores[id].counting = value > 1;
+    if (id >= open)
+    {
+      table->semaphores[id].next_free = table->free_head;
+      table->free_head = id;
+    }
+  }
+}
+
+void semaphore_table_free(SEMAPHORE_TABLE *table)
+{
+  free(table->semaphores);
+  table->semaphores = NULL;
+  table->capacity = 0;
+  table->free_head = NO_SEMAPHORE;
+}
+
+SEMAPHORE *semaphore_get(SEMAPHORE_TABLE *table, int id)
+{
+  // One unsigned compare also rejects negative IDs
+
+  if ((unsigned int) id >= (unsigned int) table->capacity ||
+    !table->semaphores[id].open)
+    return NULL;
+  return &table->semaphores[id];
+}
+
+int semaphore_create(SEMAPHORE_TABLE *table, int value)
+{
+  int id = table->free_head;
+
+  if (id == NO_SEMAPHORE || value < 0)
+    return NO_SEMAPHORE;
+
+  table->free_head = table->semaphores[id].next_free;
+  table->semaphores[id].next_free = NO_SEMAPHORE;
+  table->semaphores[id].open = TRUE;
+  table->semaphores[id].value = value;
+  table->semaphores[id].counting = value > 1;
+  return id;
+}
+
+BOOL semaphore_destroy(SEMAPHORE_TABLE *table, int id)
+{
+  SEMAPHORE *sem = semaphore_get(table, id);
+
+  if (sem == NULL || sem->ready_queue.head != NO_PID)
+    return FALSE;
+
+  semaphore_set_owner(table, id, NO_PID);
+  sem->open = FALSE;
+  sem->next_free = table->free_head;
+  table->free_head = id;
+  return TRUE;
+}
+
+void semaphore_set_owner(SEMAPHORE_TABLE *table, int id, PID_type pid)
+{
+  SEMAPHORE *sem = &table->semaphores[id];
+  PROCESS_COLD *cold;
+
+  if (sem->counting)
+    pid = NO_PID;
+  if (sem->owner == pid)
+    return;
+
+  // Unlink from the old owner's list
+
+  if (sem->owner != NO_PID)
+  {
+    if (sem->owned_prev == NO_SEMAPHORE)
+      process_cold(sem->owner)->owned_head = sem->owned_next;
+    else
+      table->semaphores[sem->owned_prev].owned_next = sem->owned_next;
+    if (sem->owned_next != NO_SEMAPHORE)
+      table->semaphores[sem->owned_next].owned_prev = sem->owned_prev;
+  }
+
+  // Link to the front of the new owner's list
+
+  sem->owner = pid;
+  sem->owned_prev = NO_SEMAPHORE;
+  sem->owned_next = NO_SEMAPHORE;
+  if (pid != NO_PID)
+  {
+    cold = process_cold(pid);
+    sem->owned_next = cold->owned_head;
+    if (cold->owned_head != NO_SEMAPHORE)
+      table->semaphores[cold->owned_head].owned_prev = id;
+    cold->owned_head = id;
+  }
+}
+
+void semaphore_release_all(SEMAPHORE_TABLE *table, PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+
+  while (cold->owned_head != NO_SEMAPHORE)
+    semaphore_set_owner(table, cold->owned_head, NO_PID);
+}
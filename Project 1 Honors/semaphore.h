@@ -0,0 +1,84 @@
+
+/* The semaphore table. Its size is chosen at run time (see
+   kernel_set_semaphores() in kernel.h) and every semaphore's wait queue is
+   an intrusive PID_QUEUE inside it, so UP and DOWN never allocate and take
+   constant time however many semaphores there are.
+
+   A semaphore ID is an index into the table. The first semaphores are
+   open from the start, as the original 16 always were; the rest are
+   closed and kept on a free list until a process creates one. IDs are
+   checked against the table, so an out of range or closed ID is reported
+   instead of touching memory outside it.
+
+   For deadlock detection, a semaphore that has never had a value above 1
+   is treated as a lock: while its value is 0 it is owned by the process
+   that took it last (with a DOWN, or handed over by an UP), and every
+   process keeps the semaphores it owns on a list threaded through them.
+   Once a semaphore's value goes above 1 it counts, has no single owner
+   and is never owned again. */
+
+// Operations of the SEMAPHORE_OP trap, in R3. The supplied hardware only
+// issues DOWN and UP.
+
+#define SEMAPHORE_DOWN 0
+#define SEMAPHORE_UP 1
+#define SEMAPHORE_CREATE 2   /* initial value in R2; the new ID is put in R2 */
+#define SEMAPHORE_DESTROY 3  /* ID in R2 */
+#define SEMAPHORE_DOWN_TIMED 4  /* timeout in ms in R4 (see kernel.h) */
+
+// Marks the end of the free list (and "no semaphore" in general)
+
+#define NO_SEMAPHORE -1
+
+typedef struct {
+  PID_QUEUE ready_queue;
+  int value;
+  BOOL open;
+  int next_free;  // next closed semaphore on the free list
+
+  // The owner (NO_PID if none) and the neighbours on its list of owned
+  // semaphores
+
+  PID_type owner;
+  int owned_next;
+  int owned_prev;
+  BOOL counting;  // the value has been above 1
+} SEMAPHORE;
+
+typedef struct {
+  SEMAPHORE *semaphores;
+  int capacity;
+  int free_head;
+} SEMAPHORE_TABLE;
+
+// Sets up a table of capacity semaphores of which the first open ones are
+// open with the given value
+
+void semaphore_table_init(SEMAPHORE_TABLE *table, int capacity, int open,
+  int value);
+
+// Frees a table's semaphores
+
+void semaphore_table_free(SEMAPHORE_TABLE *table);
+
+// Returns an open semaphore, or NULL if the ID is out of range or closed
+
+SEMAPHORE *semaphore_get(SEMAPHORE_TABLE *table, int id);
+
+// Opens a closed semaphore with the given value and returns its ID, or
+// NO_SEMAPHORE if every semaphore is open or the value is negative
+
+int semaphore_create(SEMAPHORE_TABLE *table, int value);
+
+// Makes a process (or NO_PID) the owner of a semaphore, unless it counts
+
+void semaphore_set_owner(SEMAPHORE_TABLE *table, int id, PID_type pid);
+
+// Gives up every semaphore a process owns (when it exits)
+
+void semaphore_release_all(SEMAPHORE_TABLE *table, PID_type pid);
+
+// Closes an open semaphore that nobody waits on. Returns FALSE (and leaves
+// the semaphore alone) otherwise.
+
+BOOL semaphore_destroy(SEMAPHORE_TABLE *table, int id);
@@ -0,0 +1,1230 @@
+/* An event-driven stand-in for hardware.o and drivers.o, so the kernel can
+   be run on machines the supplied objects do not link on:
+
+   make simulator
+   ./simulator [-b log file | -q] [-m metrics file] [-s semaphores[,open]]
+               [-d report | stop] [-D fifo | sstf | deadline]
+               [-S mlfq | cfs | stride | lottery]
+               [-Q quantum,... ] [-B boost period] [-A allotment]
+               [-G group period] [-R writer | fair] [-V]
+               [-c time,checkpoint file] [-r checkpoint file]
+               [trace file]                     (processes.dat by default)
+
+   -b writes the kernel's events to a binary log (see event_log.h) instead
+   of printing them, -q only counts them. Either way the number of events
+   and how long the run took are reported on stderr at the end. -m writes
+   the kernel's latency metrics when the run ends, as JSON if the file name
+   ends in .json and as CSV otherwise. -s sizes the semaphore table, with
+   every semaphore open unless a smaller number of open ones is given. -d
+   makes the kernel report deadlock cycles as they form, and with stop end
+   the run at the first one that no other process can break. -D puts a
+   disk request scheduler with that policy in front of the disk (see
+   disk.h); how many reads it merged into how many requests is reported
+   on stderr. -S picks the kernel's scheduling policy (see scheduler.h).
+   -Q, -B and -A tune the MLFQ (see kernel_set_mlfq()): the quanta of its
+   levels from the lowest up (the last one given applies to the levels
+   above it), how often it boosts every process to the top level and how
+   long a process may run at a level before it drops. -G sets how long
+   the period of group quotas is (see group.h). -R sets how reader-writer
+   locks order their waiters (see sync.h), preferring writers by default.
+   -V issues two or more traps in a row as one BATCH trap (see kernel.h).
+   The number of context switches per second of simulated time, and of
+   dispatches after a long wait, are reported on stderr, as are how many
+   real-time jobs missed their deadline and how many trap entries
+   batching saved.
+
+   The trace has the same format as processes.dat, one event per line:
+
+   <pid> run <ms>          compute for <ms> milliseconds
+   <pid> diskread <size> [<block>]
+                           DISK_READ trap with R2 = size, R3 = block
+                           (NO_BLOCK if not given)
+   <pid> adiskread <size> [<block>]
+                           DISK_READ_ASYNC trap with R2 = size, R3 = block
+                           (NO_BLOCK if not given)
+   <pid> diskwait <count>  DISK_WAIT trap with R2 = count
+   <pid> keyboardread      KEYBOARD_READ trap
+   <pid> diskwrite         DISK_WRITE trap
+   <pid> down <sem> [<timeout>]
+                           SEMAPHORE_OP trap with R2 = sem, R3 = 0, or
+                           with a timeout R3 = down timed, R4 = timeout
+   <pid> up <sem>          SEMAPHORE_OP trap with R2 = sem, R3 = 1
+   <pid> fork <child> [<tickets>]
+                           FORK_PROGRAM trap with R2 = child, R3 = tickets
+   <pid> semcreate <value> SEMAPHORE_OP trap with R2 = value, R3 = create
+   <pid> semdestroy <sem>  SEMAPHORE_OP trap with R2 = sem, R3 = destroy
+   <pid> nice <value>      SET_NICE trap with R2 = value
+   <pid> sleep <ms>        SLEEP trap with R2 = ms
+   <pid> groupcreate <weight> [<quota>]
+                           GROUP_OP trap with R2 = weight, R3 = create,
+                           R4 = quota
+   <pid> groupjoin <group> GROUP_OP trap with R2 = group, R3 = join
+   <pid> realtime <runtime> <period> [<deadline>]
+                           SET_REALTIME trap with R2 = runtime, R3 =
+                           period, R4 = deadline
+   <pid> rlock <lock>      RWLOCK_OP trap with R2 = lock, R3 = read
+   <pid> wlock <lock>      RWLOCK_OP trap with R2 = lock, R3 = write
+   <pid> unlock <lock>     RWLOCK_OP trap with R2 = lock, R3 = unlock
+   <pid> condwait <cond> <lock>
+                           CONDVAR_OP trap with R2 = cond, R3 = wait,
+                           R4 = lock
+   <pid> signal <cond>     CONDVAR_OP trap with R2 = cond, R3 = signal
+   <pid> broadcast <cond>  CONDVAR_OP trap with R2 = cond, R3 = broadcast
+
+   Each process's events run in file order; a process whose events are used
+   up issues END_PROGRAM. Process 0 is running when the machine boots.
+
+   The trace can also be a binary trace made by trace_convert (see
+   trace.h), which is mapped into memory and run from there instead of
+   being parsed. How long loading the trace took is reported on stderr.
+
+   -c stops the run at the first event at or after the given time and
+   writes a checkpoint of the whole simulation (the kernel's snapshot, see
+   kernel_save(), and the simulator's clock, pending I/O and place in the
+   trace) to the file. -r carries on from such a checkpoint, of the same
+   trace, instead of booting; -S, -Q, -B and -A then change the scheduling
+   from that point on, while the semaphores, disk policy, group period,
+   reader-writer lock mode and deadlock detection stay as they were when
+   the checkpoint was written.
+
+   Built with -DTHREAD_LOCAL_HARDWARE (make simulator_mt), the simulator
+   takes several traces and runs them at once on a fixed pool of worker
+   threads, as many as there are CPUs or as -j gives. Each worker has a
+   machine of its own and takes the next trace nobody has run yet until
+   none are left. Each trace's messages go to its name with .out added,
+   and its report to stderr with its name in front; a trace that cannot
+   be run only fails itself, making the exit status 1 once the others are
+   done. -b, -m, -c and -r take a single trace. make check_parallel checks
+   that the sample traces print the same that way as run one at a time.
+
+   Rather than stepping the clock one millisecond at a time, the simulator
+   keeps the pending I/O completions in a min-heap and jumps the clock
+   straight to the earliest of: the next completion, the end of a running
+   process's burst and the first clock tick at or after a CPU's next
+   deadline (see kernel_next_deadline()). Ticks before the deadline would
+   not do anything, so they are never delivered. A long run burst or a long
+   idle stretch costs a handful of events instead of one step per
+   simulated millisecond.
+
+   With a kernel built for several CPUs (see kernel_select_cpu()), every
+   CPU's process computes at once as the clock advances, and each CPU gets
+   its own traps and clock interrupts. I/O interrupts go to an idle CPU if
+   there is one, and to CPU 0 otherwise. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// pthread.h brings in time.h, whose clock() would clash with the
+// machine's clock
+
+#ifdef THREAD_LOCAL_HARDWARE
+#define clock time_h_clock
+#include <pthread.h>
+#undef clock
+#include <unistd.h>
+#endif
+
+#include "hardware.h"
+#include "drivers.h"
+#include "kernel.h"
+#include "event_log.h"
+#include "process_table.h"
+#include "semaphore.h"
+#include "disk.h"
+#include "scheduler.h"
+#include "group.h"
+#include "sync.h"
+#include "trace.h"
+
+// The machine's registers, clock and interrupt table. Like them,
+// everything else the simulator keeps about the machine below belongs to
+// the thread simulating it when built with THREAD_LOCAL_HARDWARE.
+
+HARDWARE_REGISTER PID_type current_pid;
+HARDWARE_REGISTER int R1, R2, R3, R4;
+HARDWARE_REGISTER CLOCK_TIME clock;
+HARDWARE_REGISTER FN_TYPE INTERRUPT_TABLE[KEYBOARD_INTERRUPT + 1];
+
+// A simulated program: its events, the next one to run and how much of
+// the current run burst is left. The events of a binary trace are where
+// it is mapped, read-only; event_capacity is 0 for those.
+
+typedef struct {
+  TRACE_EVENT *events;
+  int event_count;
+  int event_capacity;
+  int pc;
+  int remaining;
+} PROGRAM;
+
+HARDWARE_REGISTER PROGRAM *programs;
+HARDWARE_REGISTER int program_count;
+
+// Where a binary trace is mapped (NULL for a text trace)
+
+HARDWARE_REGISTER void *trace_map;
+HARDWARE_REGISTER size_t trace_map_size;
+
+// A pending I/O completion. seq keeps completions due at the same time in
+// the order they were requested.
+
+typedef struct {
+  CLOCK_TIME time;
+  unsigned int seq;
+  int interrupt;
+  PID_type pid;
+} IO_EVENT;
+
+HARDWARE_REGISTER IO_EVENT *io_heap;
+HARDWARE_REGISTER int io_count;
+HARDWARE_REGISTER int io_capacity;
+HARDWARE_REGISTER unsigned int io_seq;
+
+// The disk serves one read at a time; this is when it is next free
+
+HARDWARE_REGISTER CLOCK_TIME disk_free_time;
+
+// Returns the program of a PID, growing the program array if needed
+
+static PROGRAM *program(PID_type pid)
+{
+  int old_count = program_count;
+
+  if (pid >= program_count)
+  {
+    while (program_count <= pid)
+      program_count = program_count ? program_count * 2 : 16;
+    programs = (PROGRAM *) realloc(programs, program_count * sizeof(PROGRAM));
+    memset(programs + old_count, 0,
+      (program_count - old_count) * sizeof(PROGRAM));
+  }
+  return &programs[pid];
+}
+
+static BOOL load_text_trace(const char *path, FILE *in)
+{
+  char line[256];
+  int line_number = 0, result;
+  PID_type pid;
+  TRACE_EVENT event;
+  PROGRAM *prog;
+
+  while (fgets(line, sizeof(line), in) != NULL)
+  {
+    line_number++;
+    if ((result = trace_parse_line(line, &pid, &event)) == 0)
+      continue;
+    if (result < 0)
+    {
+      fprintf(stderr, "%s:%d: bad trace line\n", path, line_number);
+      return FALSE;
+    }
+
+    prog = program(pid);
+    if (prog->event_count == prog->event_capacity)
+    {
+      prog->event_capacity = prog->event_capacity ?
+        prog->event_capacity * 2 : 16;
+      prog->events = (TRACE_EVENT *) realloc(prog->events,
+        prog->event_capacity * sizeof(TRACE_EVENT));
+    }
+    prog->events[prog->event_count++] = event;
+  }
+  return TRUE;
+}
+
+// Maps a binary trace and points every program at its events in place
+
+static BOOL load_binary_trace(const char *path, FILE *in)
+{
+  struct stat st;
+  const TRACE_HEADER *header;
+  const TRACE_INDEX *index;
+  void *map;
+  int pid;
+
+  if (fstat(fileno(in), &st) || st.st_size < (off_t) sizeof(TRACE_HEADER) ||
+    (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0)) ==
+    MAP_FAILED)
+  {
+    fprintf(stderr, "%s: cannot map the trace\n", path);
+    return FALSE;
+  }
+  trace_map = map;
+  trace_map_size = st.st_size;
+
+  header = (const TRACE_HEADER *) map;
+  index = trace_index(header);
+  if (header->program_count < 0 || header->event_count < 0 ||
+    trace_size(header->program_count, header->event_count) != st.st_size)
+  {
+    fprintf(stderr, "%s: truncated binary trace\n", path);
+    return FALSE;
+  }
+
+  if (header->program_count)
+    program(header->program_count - 1);
+  for (pid = 0; pid < header->program_count; pid++)
+  {
+    if (index[pid].first < 0 || index[pid].count < 0 ||
+      index[pid].first + index[pid].count > header->event_count)
+    {
+      fprintf(stderr, "%s: bad index entry for process %d\n", path, pid);
+      return FALSE;
+    }
+    programs[pid].events = (TRACE_EVENT *) trace_events(header) +
+      index[pid].first;
+    programs[pid].event_count = index[pid].count;
+  }
+
+  // The mapping lasts as long as the run; the events are only read, so
+  // pages are faulted in from the page cache as processes get to them
+
+  return TRUE;
+}
+
+// Loads a trace, text or binary (see trace.h), and returns whether it
+// could; what is wrong with it is reported on stderr
+
+static BOOL load_trace(const char *path)
+{
+  char magic[sizeof(TRACE_MAGIC)];
+  FILE *in = fopen(path, "rb");
+  BOOL ok;
+
+  if (in == NULL)
+  {
+    perror(path);
+    return FALSE;
+  }
+
+  if (fread(magic, 1, sizeof(magic), in) == sizeof(magic) &&
+    !memcmp(magic, TRACE_MAGIC, sizeof(magic)))
+    ok = load_binary_trace(path, in);
+  else
+  {
+    rewind(in);
+    ok = load_text_trace(path, in);
+  }
+  fclose(in);
+  return ok;
+}
+
+// Frees the calling thread's trace and pending I/O, so that its machine
+// can run another trace
+
+static void unload_trace()
+{
+  int pid;
+
+  for (pid = 0; pid < program_count; pid++)
+    if (programs[pid].event_capacity)
+      free(programs[pid].events);
+  if (trace_map != NULL)
+    munmap(trace_map, trace_map_size);
+  free(programs);
+  free(io_heap);
+  programs = NULL;
+  program_count = 0;
+  trace_map = NULL;
+  io_heap = NULL;
+  io_count = 0;
+  io_capacity = 0;
+  io_seq = 0;
+  disk_free_time = 0;
+}
+
+static BOOL io_before(IO_EVENT *a, IO_EVENT *b)
+{
+  return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void io_push(CLOCK_TIME time, int interrupt, PID_type pid)
+{
+  IO_EVENT event;
+  int i;
+
+  if (io_count == io_capacity)
+  {
+    io_capacity = io_capacity ? io_capacity * 2 : 64;
+    io_heap = (IO_EVENT *) realloc(io_heap, io_capacity * sizeof(IO_EVENT));
+  }
+
+  event.time = time;
+  event.seq = io_seq++;
+  event.interrupt = interrupt;
+  event.pid = pid;
+
+  // Sift up
+
+  for (i = io_count++; i > 0 && io_before(&event, &io_heap[(i - 1) / 2]);
+    i = (i - 1) / 2)
+    io_heap[i] = io_heap[(i - 1) / 2];
+  io_heap[i] = event;
+}
+
+static IO_EVENT io_pop()
+{
+  IO_EVENT top = io_heap[0];
+  IO_EVENT last = io_heap[--io_count];
+  int i = 0, child;
+
+  // Sift the last event down from the root
+
+  while ((child = 2 * i + 1) < io_count)
+  {
+    if (child + 1 < io_count && io_before(&io_heap[child + 1], &io_heap[child]))
+      child++;
+    if (!io_before(&io_heap[child], &last))
+      break;
+    io_heap[i] = io_heap[child];
+    i = child;
+  }
+  io_heap[i] = last;
+  return top;
+}
+
+void disk_read_req(PID_type pid, int size)
+{
+  CLOCK_TIME start = disk_free_time > clock ? disk_free_time : clock;
+
+  disk_free_time = start + DISK_READ_OVERHEAD + size * BLOCK_READ_TIME;
+  io_push(disk_free_time, DISK_INTERRUPT, pid);
+}
+
+void keyboard_read_req(PID_type pid)
+{
+  io_push(clock + KEYBOARD_READ_OVERHEAD, KEYBOARD_INTERRUPT, pid);
+}
+
+void disk_write_req(PID_type pid)
+{
+}
+
+// Loads the registers with the trap an event (other than a RUN) issues
+
+static void set_trap(const TRACE_EVENT *event)
+{
+  switch (event->op)
+  {
+    case DISK_READ_EVENT:
+      R1 = DISK_READ;
+      R2 = event->arg;
+      R3 = event->arg2;
+      break;
+    case DISK_READ_ASYNC_EVENT:
+      R1 = DISK_READ_ASYNC;
+      R2 = event->arg;
+      R3 = event->arg2;
+      break;
+    case DISK_WAIT_EVENT:
+      R1 = DISK_WAIT;
+      R2 = event->arg;
+      break;
+    case KEYBOARD_READ_EVENT:
+      R1 = KEYBOARD_READ;
+      break;
+    case DISK_WRITE_EVENT:
+      R1 = DISK_WRITE;
+      break;
+    case DOWN:
+    case UP:
+      R1 = SEMAPHORE_OP;
+      R2 = event->arg;
+      R3 = event->op == UP ? SEMAPHORE_UP : SEMAPHORE_DOWN;
+      if (event->op == DOWN && event->arg2 > 0)
+      {
+        R3 = SEMAPHORE_DOWN_TIMED;
+        R4 = event->arg2;
+      }
+      break;
+    case SEMAPHORE_CREATE_EVENT:
+    case SEMAPHORE_DESTROY_EVENT:
+      R1 = SEMAPHORE_OP;
+      R2 = event->arg;
+      R3 = event->op == SEMAPHORE_CREATE_EVENT ? SEMAPHORE_CREATE :
+        SEMAPHORE_DESTROY;
+      break;
+    case FORK:
+      R1 = FORK_PROGRAM;
+      R2 = event->arg;
+      R3 = event->arg2;
+      break;
+    case NICE:
+      R1 = SET_NICE;
+      R2 = event->arg;
+      break;
+    case SLEEP_EVENT:
+      R1 = SLEEP;
+      R2 = event->arg;
+      break;
+    case GROUP_CREATE_EVENT:
+    case GROUP_JOIN_EVENT:
+      R1 = GROUP_OP;
+      R2 = event->arg;
+      R3 = event->op == GROUP_CREATE_EVENT ? GROUP_CREATE : GROUP_JOIN;
+      R4 = event->arg2;
+      break;
+    case REALTIME_EVENT:
+      R1 = SET_REALTIME;
+      R2 = event->arg;
+      R3 = event->arg2;
+      R4 = event->arg3;
+      break;
+    case RLOCK_EVENT:
+    case WLOCK_EVENT:
+    case UNLOCK_EVENT:
+      R1 = RWLOCK_OP;
+      R2 = event->arg;
+      R3 = event->op == RLOCK_EVENT ? RWLOCK_READ :
+        event->op == WLOCK_EVENT ? RWLOCK_WRITE : RWLOCK_UNLOCK;
+      break;
+    case CONDWAIT_EVENT:
+    case SIGNAL_EVENT:
+    case BROADCAST_EVENT:
+      R1 = CONDVAR_OP;
+      R2 = event->arg;
+      R3 = event->op == CONDWAIT_EVENT ? CONDVAR_WAIT :
+        event->op == SIGNAL_EVENT ? CONDVAR_SIGNAL : CONDVAR_BROADCAST;
+      R4 = event->arg2;
+      break;
+  }
+}
+
+// The context's batch when consecutive traps are batched (-V), else NULL
+
+static HARDWARE_REGISTER BATCH_BUFFER *batch;
+
+// Runs the current process's instantaneous events (traps) until it has
+// computing to do, or the processor goes idle. With batching, two or more
+// traps in a row go in one BATCH trap, and those it did not run are
+// issued next time.
+
+static void run_traps()
+{
+  PROGRAM *prog;
+  TRACE_EVENT *event;
+  PID_type pid;
+  int count;
+
+  while (current_pid != IDLE_PROCESS &&
+    (prog = program(current_pid))->remaining == 0)
+  {
+    if (prog->pc == prog->event_count)
+    {
+      R1 = END_PROGRAM;
+      INTERRUPT_TABLE[TRAP]();
+      continue;
+    }
+
+    event = &prog->events[prog->pc];
+    if (event->op == RUN)
+    {
+      prog->remaining = event->arg;
+      prog->pc++;
+      continue;
+    }
+
+    for (count = 0; batch != NULL && count < MAX_BATCH &&
+      prog->pc + count < prog->event_count && event[count].op != RUN;
+      count++)
+    {
+      set_trap(&event[count]);
+      batch->ops[count].trap = R1;
+      batch->ops[count].arg = R2;
+      batch->ops[count].arg2 = R3;
+      batch->ops[count].arg3 = R4;
+    }
+    if (count < 2)
+    {
+      prog->pc++;
+      set_trap(event);
+      INTERRUPT_TABLE[TRAP]();
+      continue;
+    }
+
+    // A fork may move the programs, so the process's is found again
+
+    pid = current_pid;
+    R1 = BATCH;
+    R2 = count;
+    INTERRUPT_TABLE[TRAP]();
+    program(pid)->pc += batch->done;
+  }
+}
+
+// First clock tick strictly after the current time and no earlier than
+// the deadline, or NO_DEADLINE if there is none before the clock wraps
+
+static CLOCK_TIME next_tick(CLOCK_TIME deadline)
+{
+  CLOCK_TIME after = deadline > clock ? deadline - 1 : clock;
+
+  if (after >= LAST_TICK_TIME)
+    return NO_DEADLINE;
+  return (after / CLOCK_INTERRUPT_PERIOD + 1) * CLOCK_INTERRUPT_PERIOD;
+}
+
+/* A checkpoint is the hardware's state, then the kernel's snapshot (see
+   kernel_save() in kernel.h): a CHECKPOINT_HEADER, the pending I/O
+   completions as they lie in the heap and every program's place in the
+   trace. It can only be restored with the same trace. */
+
+#define CHECKPOINT_MAGIC "KSIM1"
+
+typedef struct {
+  char magic[8];
+  CLOCK_TIME clock;
+  PID_type current_pid;
+  int registers[4];
+  CLOCK_TIME disk_free_time;
+  unsigned int io_seq;
+  int io_count;
+  int program_count;
+} CHECKPOINT_HEADER;
+
+typedef struct {
+  int event_count;  // to check the trace is the same
+  int pc;
+  int remaining;
+} PROGRAM_CURSOR;
+
+static BOOL save_checkpoint(const char *path, KERNEL_CONTEXT *context)
+{
+  CHECKPOINT_HEADER header;
+  PROGRAM_CURSOR cursor;
+  FILE *out = fopen(path, "wb");
+  BOOL ok;
+  int pid;
+
+  if (out == NULL)
+  {
+    perror(path);
+    return FALSE;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  header.clock = clock;
+  header.current_pid = current_pid;
+  header.registers[0] = R1;
+  header.registers[1] = R2;
+  header.registers[2] = R3;
+  header.registers[3] = R4;
+  header.disk_free_time = disk_free_time;
+  header.io_seq = io_seq;
+  header.io_count = io_count;
+  header.program_count = program_count;
+
+  ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+    fwrite(io_heap, sizeof(IO_EVENT), io_count, out) == (size_t) io_count;
+  for (pid = 0; ok && pid < program_count; pid++)
+  {
+    cursor.event_count = programs[pid].event_count;
+    cursor.pc = programs[pid].pc;
+    cursor.remaining = programs[pid].remaining;
+    ok = fwrite(&cursor, sizeof(cursor), 1, out) == 1;
+  }
+  ok = ok && kernel_save(context, out);
+  if (fclose(out) || !ok)
+  {
+    fprintf(stderr, "%s: cannot write the checkpoint\n", path);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static BOOL restore_checkpoint(const char *path, KERNEL_CONTEXT *context)
+{
+  CHECKPOINT_HEADER header;
+  PROGRAM_CURSOR cursor;
+  FILE *in = fopen(path, "rb");
+  const char *error = NULL;
+  int pid;
+
+  if (in == NULL)
+  {
+    perror(path);
+    return FALSE;
+  }
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+    memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) ||
+    header.io_count < 0 || header.program_count < 0)
+    error = "not a checkpoint";
+  else
+  {
+    io_heap = (IO_EVENT *) realloc(io_heap,
+      (header.io_count + 1) * sizeof(IO_EVENT));
+    io_capacity = header.io_count + 1;
+    io_count = header.io_count;
+    if (fread(io_heap, sizeof(IO_EVENT), io_count, in) != (size_t) io_count)
+      error = "truncated checkpoint";
+  }
+
+  for (pid = 0; error == NULL && pid < header.program_count; pid++)
+  {
+    if (fread(&cursor, sizeof(cursor), 1, in) != 1 ||
+      cursor.event_count != program(pid)->event_count ||
+      cursor.pc < 0 || cursor.pc > cursor.event_count)
+      error = "not a checkpoint of this trace";
+    else
+    {
+      programs[pid].pc = cursor.pc;
+      programs[pid].remaining = cursor.remaining;
+    }
+  }
+
+  if (error == NULL && !kernel_restore(context, in))
+    error = "the kernel's snapshot is short or from another build";
+  fclose(in);
+  if (error != NULL)
+  {
+    fprintf(stderr, "%s: %s\n", path, error);
+    return FALSE;
+  }
+
+  clock = header.clock;
+  current_pid = header.current_pid;
+  R1 = header.registers[0];
+  R2 = header.registers[1];
+  R3 = header.registers[2];
+  R4 = header.registers[3];
+  disk_free_time = header.disk_free_time;
+  io_seq = header.io_seq;
+  return TRUE;
+}
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// The command line's settings, applied to the context of every run
+
+typedef struct {
+  KERNEL_LOG_MODE mode;
+  const char *log_path;
+  const char *metrics_path;
+  int semaphores, open;
+  int deadlock_detection;
+  int disk_policy;
+  int scheduler;
+  int quanta[NUMBER_OF_PRIORITY_LEVELS], levels, boost_period, allotment;
+  BOOL tune_mlfq;
+  int group_period;
+  int rwlock_mode;
+  BOOL batch;
+  int workers;
+  CLOCK_TIME checkpoint_time;
+  const char *checkpoint, *snapshot;
+} OPTIONS;
+
+// One run of a trace, and what it reports on stderr at the end
+
+typedef struct {
+  const OPTIONS *options;
+  const char *trace;
+  FILE *out;  // the text log, if the log is text
+  int status;
+  double loaded, elapsed;
+  unsigned long events, traps, operations;
+  int reads, requests, switches, starved, jobs, misses;
+  CLOCK_TIME finished;
+} SIMULATION;
+
+// Parses the options before the traces into options and returns the
+// index of the first trace, or -1 if the command line is wrong
+
+static int parse_options(int argc, char **argv, OPTIONS *options)
+{
+  static const char *policies[] = { "fifo", "sstf", "deadline" };
+  static const char *schedulers[NUMBER_OF_SCHED_POLICIES] = { "mlfq", "cfs",
+    "stride", "lottery" };
+  const char *name;
+  char *end;
+  int arg, policy, open;
+
+  memset(options, 0, sizeof(*options));
+  options->mode = KERNEL_LOG_TEXT;
+  options->deadlock_detection = -1;
+  options->disk_policy = -1;
+  options->scheduler = -1;
+  options->rwlock_mode = -1;
+
+  for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+  {
+    if (!strcmp(argv[arg], "-q"))
+      options->mode = KERNEL_LOG_QUIET;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-b"))
+    {
+      options->mode = KERNEL_LOG_BINARY;
+      options->log_path = argv[++arg];
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-m"))
+      options->metrics_path = argv[++arg];
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-s") &&
+      sscanf(argv[arg + 1], "%d", &options->semaphores) == 1 &&
+      options->semaphores > 0)
+    {
+      options->open = options->semaphores;
+      sscanf(argv[++arg], "%*d,%d", &options->open);
+      if (options->open > options->semaphores)
+        options->open = options->semaphores;
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-d") &&
+      (!strcmp(argv[arg + 1], "report") || !strcmp(argv[arg + 1], "stop")))
+      options->deadlock_detection = !strcmp(argv[++arg], "stop") ?
+        KERNEL_DEADLOCK_STOP : KERNEL_DEADLOCK_REPORT;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-D"))
+    {
+      arg++;
+      for (policy = 0; policy < 3; policy++)
+        if (!strcmp(argv[arg], policies[policy]))
+          break;
+      if (policy == 3)
+      {
+        fprintf(stderr, "unknown disk policy %s\n", argv[arg]);
+        return -1;
+      }
+      options->disk_policy = DISK_FIFO + policy;
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-S"))
+    {
+      arg++;
+      for (policy = 0; policy < NUMBER_OF_SCHED_POLICIES; policy++)
+        if (!strcmp(argv[arg], schedulers[policy]))
+          break;
+      if (policy == NUMBER_OF_SCHED_POLICIES)
+      {
+        fprintf(stderr, "unknown scheduler %s\n", argv[arg]);
+        return -1;
+      }
+      options->scheduler = policy;
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-Q"))
+    {
+      name = argv[++arg];
+      for (options->levels = 0;
+        options->levels < NUMBER_OF_PRIORITY_LEVELS; )
+      {
+        options->quanta[options->levels] = strtol(name, &end, 10);
+        if (end == name || options->quanta[options->levels] <= 0)
+        {
+          fprintf(stderr, "bad quanta %s\n", argv[arg]);
+          return -1;
+        }
+        options->levels++;
+        if (*end != ',')
+          break;
+        name = end + 1;
+      }
+      for (; options->levels < NUMBER_OF_PRIORITY_LEVELS; options->levels++)
+        options->quanta[options->levels] =
+          options->quanta[options->levels - 1];
+      options->tune_mlfq = TRUE;
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-B") &&
+      sscanf(argv[arg + 1], "%d", &options->boost_period) == 1 &&
+      options->boost_period >= 0)
+    {
+      arg++;
+      options->tune_mlfq = TRUE;
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-A") &&
+      sscanf(argv[arg + 1], "%d", &options->allotment) == 1 &&
+      options->allotment >= 0)
+    {
+      arg++;
+      options->tune_mlfq = TRUE;
+    }
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-G") &&
+      sscanf(argv[arg + 1], "%d", &options->group_period) == 1 &&
+      options->group_period > 0)
+      arg++;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-R") &&
+      (!strcmp(argv[arg + 1], "writer") || !strcmp(argv[arg + 1], "fair")))
+      options->rwlock_mode = !strcmp(argv[++arg], "fair") ?
+        RWLOCK_FAIR : RWLOCK_WRITER_PREFERRED;
+    else if (!strcmp(argv[arg], "-V"))
+      options->batch = TRUE;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-c") &&
+      sscanf(argv[arg + 1], "%u,%n", &options->checkpoint_time, &open) == 1 &&
+      argv[arg + 1][open])
+      options->checkpoint = argv[++arg] + open;
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-r"))
+      options->snapshot = argv[++arg];
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-j") &&
+      sscanf(argv[arg + 1], "%d", &options->workers) == 1 &&
+      options->workers > 0)
+      arg++;
+    else
+      return -1;
+  }
+  return arg;
+}
+
+// Boots the calling thread's machine with a context, or restores it from
+// the checkpoint, and runs it to the end. Returns FALSE if the run went
+// wrong, having said why on stderr.
+
+static BOOL run_machine(const OPTIONS *options, KERNEL_CONTEXT *context)
+{
+  CLOCK_TIME next, deadline;
+  IO_EVENT event;
+  double start = now();
+  int cpu, cpus = kernel_cpu_count();
+
+  // A restored kernel takes the place of booting one; the scheduler and
+  // its tuning apply from there on
+
+  kernel_select(context);
+  if (options->snapshot != NULL)
+  {
+    if (!restore_checkpoint(options->snapshot, context))
+      return FALSE;
+    fprintf(stderr, "checkpoint restored in %.3f s\n", now() - start);
+  }
+  if (options->scheduler >= 0)
+    kernel_set_scheduler(context, options->scheduler);
+  if (options->tune_mlfq)
+    kernel_set_mlfq(context, options->levels ? options->quanta : NULL,
+      options->boost_period, options->allotment);
+  if (options->snapshot == NULL)
+  {
+    clock = 0;
+    current_pid = 0;
+    initialize_kernel();
+  }
+
+  while (kernel_result(context) == KERNEL_RUNNING)
+  {
+    if (options->checkpoint != NULL && clock >= options->checkpoint_time)
+    {
+      if (!save_checkpoint(options->checkpoint, context))
+        return FALSE;
+      fprintf(stderr, "checkpoint at %d ms written to %s\n", clock,
+        options->checkpoint);
+      break;
+    }
+
+    // Every CPU runs its process's traps
+
+    for (cpu = 0; cpu < cpus && kernel_result(context) == KERNEL_RUNNING;
+      cpu++)
+    {
+      kernel_select_cpu(cpu);
+      run_traps();
+    }
+    if (kernel_result(context) != KERNEL_RUNNING)
+      break;
+
+    // Find the next event: the end of a CPU's burst, an I/O completion or
+    // the clock tick a CPU needs
+
+    next = NO_DEADLINE;
+    for (cpu = 0; cpu < cpus; cpu++)
+    {
+      kernel_select_cpu(cpu);
+      if (current_pid != IDLE_PROCESS &&
+        program(current_pid)->remaining < next - clock)
+        next = clock + program(current_pid)->remaining;
+      deadline = kernel_next_deadline();
+      if (deadline != NO_DEADLINE && next_tick(deadline) < next)
+        next = next_tick(deadline);
+    }
+    if (io_count && io_heap[0].time < next)
+      next = io_heap[0].time;
+
+    if (next == NO_DEADLINE)
+    {
+      fprintf(stderr, "Time %u: nothing left that can happen before the "
+        "clock wraps\n", clock);
+      return FALSE;
+    }
+
+    // Jump to it, every CPU's process computing all the while, then
+    // deliver the I/O interrupts due, each on an idle CPU if there is one,
+    // and the clock interrupt on every CPU that wants one now
+
+    for (cpu = 0; cpu < cpus; cpu++)
+    {
+      kernel_select_cpu(cpu);
+      if (current_pid != IDLE_PROCESS)
+        program(current_pid)->remaining -= next - clock;
+    }
+    clock = next;
+
+    while (io_count && io_heap[0].time <= clock &&
+      kernel_result(context) == KERNEL_RUNNING)
+    {
+      event = io_pop();
+      for (cpu = 0; cpu < cpus; cpu++)
+      {
+        kernel_select_cpu(cpu);
+        if (current_pid == IDLE_PROCESS)
+          break;
+      }
+      if (cpu == cpus)
+        kernel_select_cpu(0);
+      R1 = event.pid;
+      INTERRUPT_TABLE[event.interrupt]();
+    }
+
+    for (cpu = 0; cpu < cpus && clock % CLOCK_INTERRUPT_PERIOD == 0 &&
+      kernel_result(context) == KERNEL_RUNNING; cpu++)
+    {
+      kernel_select_cpu(cpu);
+      deadline = kernel_next_deadline();
+      if (deadline != NO_DEADLINE && clock >= deadline)
+        INTERRUPT_TABLE[CLOCK_INTERRUPT]();
+    }
+  }
+
+  return TRUE;
+}
+
+// Runs a trace to the end on the calling thread's machine. Whatever goes
+// wrong (a file that cannot be opened, a bad trace or checkpoint) only
+// fails this run, with a status of 1.
+
+static void simulate(SIMULATION *run)
+{
+  const OPTIONS *options = run->options;
+  KERNEL_CONTEXT *context;
+  KERNEL_METRICS_FORMAT metrics_format = KERNEL_METRICS_CSV;
+  FILE *log_file = run->out, *metrics_file = NULL;
+  const char *name = options->metrics_path;
+  double start;
+  int type;
+
+  run->status = 1;
+  if (options->log_path != NULL &&
+    (log_file = fopen(options->log_path, "wb")) == NULL)
+  {
+    perror(options->log_path);
+    return;
+  }
+  if (name != NULL && (metrics_file = fopen(name, "w")) == NULL)
+  {
+    perror(name);
+    if (log_file != run->out)
+      fclose(log_file);
+    return;
+  }
+  if (name != NULL && strlen(name) > 5 &&
+    !strcmp(name + strlen(name) - 5, ".json"))
+    metrics_format = KERNEL_METRICS_JSON;
+
+  // Every trap of the trace has its arguments in the registers
+
+  context = kernel_create();
+  kernel_set_full_registers(context, TRUE);
+  if (options->semaphores)
+    kernel_set_semaphores(context, options->semaphores, options->open);
+  if (options->deadlock_detection >= 0)
+    kernel_set_deadlock_detection(context, options->deadlock_detection);
+  if (options->disk_policy >= 0)
+    kernel_set_disk_policy(context, options->disk_policy);
+  if (options->group_period)
+    kernel_set_group_period(context, options->group_period);
+  if (options->rwlock_mode >= 0)
+    kernel_set_rwlock_mode(context, options->rwlock_mode);
+  batch = options->batch ? kernel_batch(context) : NULL;
+
+  start = now();
+  if (load_trace(run->trace))
+  {
+    run->loaded = now() - start;
+    kernel_set_log(context, options->mode, log_file);
+    kernel_set_metrics(context, metrics_format, metrics_file);
+    start = now();
+    if (run_machine(options, context))
+      run->status = 0;
+    run->finished = clock;
+  }
+
+  for (type = 0; type < NUMBER_OF_EVENT_TYPES; type++)
+    run->events += kernel_event_count(context, type);
+  kernel_disk_stats(context, &run->reads, &run->requests);
+  kernel_sched_stats(context, &run->switches, &run->starved);
+  kernel_realtime_stats(context, &run->jobs, &run->misses);
+  kernel_trap_stats(context, &run->traps, &run->operations);
+  kernel_destroy(context);
+  unload_trace();
+  if (log_file != run->out)
+    fclose(log_file);
+  if (metrics_file != NULL)
+    fclose(metrics_file);
+  fflush(run->out);
+  run->elapsed = now() - start;
+}
+
+#ifdef THREAD_LOCAL_HARDWARE
+
+// The runs of several traces, which a pool of workers take in order
+
+typedef struct {
+  SIMULATION *runs;
+  int count;
+  int next;  // the first run no worker has taken
+  pthread_mutex_t lock;
+} TRACE_QUEUE;
+
+// A worker of the pool: takes runs until none is left and does each on
+// the thread's own machine, printing to the trace's name with .out added
+
+static void *worker(void *data)
+{
+  TRACE_QUEUE *queue = (TRACE_QUEUE *) data;
+  SIMULATION *run;
+  char *name;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&queue->lock);
+    run = queue->next < queue->count ? &queue->runs[queue->next++] : NULL;
+    pthread_mutex_unlock(&queue->lock);
+    if (run == NULL)
+      return NULL;
+
+    name = (char *) malloc(strlen(run->trace) + 5);
+    sprintf(name, "%s.out", run->trace);
+    if ((run->out = fopen(name, "w")) == NULL)
+    {
+      perror(name);
+      run->status = 1;
+    }
+    else
+    {
+      simulate(run);
+      fclose(run->out);
+    }
+    free(name);
+  }
+}
+
+#endif
+
+// Reports what a run did on stderr, each line after prefix
+
+static void report(const SIMULATION *run, const char *prefix)
+{
+  fprintf(stderr, "%strace loaded in %.3f s\n", prefix, run->loaded);
+  fprintf(stderr, "%s%lu events in %.3f s (%.0f events/s)\n", prefix,
+    run->events, run->elapsed, run->events / run->elapsed);
+  fprintf(stderr, "%s%d disk reads in %d requests, finished at %u ms\n",
+    prefix, run->reads, run->requests, run->finished);
+  fprintf(stderr, "%s%d context switches (%.1f/s), %d dispatches after "
+    "waiting %d ms or more\n", prefix, run->switches,
+    run->finished ? run->switches * 1000.0 / run->finished : 0.0,
+    run->starved, STARVATION_TIME);
+  if (run->jobs)
+    fprintf(stderr, "%s%d real-time jobs, %d missed their deadline\n",
+      prefix, run->jobs, run->misses);
+  fprintf(stderr, "%s%lu operations in %lu traps, %lu trap entries saved "
+    "(%.1f%%)\n", prefix, run->operations, run->traps,
+    run->operations - run->traps, run->operations ?
+    (run->operations - run->traps) * 100.0 / run->operations : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+  OPTIONS options;
+  SIMULATION *runs;
+  int arg = parse_options(argc, argv, &options), count, status = 0;
+
+  count = arg < 0 ? 0 : argc - arg;
+  if (arg < 0 || (count > 1 && (options.log_path != NULL ||
+    options.metrics_path != NULL || options.checkpoint != NULL ||
+    options.snapshot != NULL)))
+  {
+    fprintf(stderr, "usage: %s [-b log file | -q] [-m metrics file] "
+      "[-s semaphores[,open]] [-d report | stop] "
+      "[-D fifo | sstf | deadline] [-S mlfq | cfs | stride | lottery] "
+      "[-Q quantum,...] [-B boost period] [-A allotment] "
+      "[-G group period] [-R writer | fair] [-V] "
+      "[-c time,checkpoint file] [-r checkpoint file] [trace file]\n",
+      argv[0]);
+#ifdef THREAD_LOCAL_HARDWARE
+    fprintf(stderr, "       %s [-q] [-s semaphores[,open]] ... "
+      "[-j workers] trace file trace file...\n", argv[0]);
+#endif
+    return 1;
+  }
+
+  if (count <= 1)
+  {
+    runs = (SIMULATION *) calloc(1, sizeof(SIMULATION));
+    runs->options = &options;
+    runs->trace = count ? argv[arg] : "processes.dat";
+    runs->out = stdout;
+    simulate(runs);
+    if (runs->status == 0)
+      report(runs, "");
+    return runs->status;
+  }
+
+#ifdef THREAD_LOCAL_HARDWARE
+  {
+    TRACE_QUEUE queue;
+    pthread_t *threads;
+    char prefix[256];
+    int workers = options.workers ? options.workers :
+      (int) sysconf(_SC_NPROCESSORS_ONLN), i;
+
+    // A fixed pool of workers, as many as there are CPUs unless -j says
+    // otherwise, takes the traces in turn
+
+    if (workers > count)
+      workers = count;
+    if (workers < 1)
+      workers = 1;
+    queue.runs = (SIMULATION *) calloc(count, sizeof(SIMULATION));
+    queue.count = count;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    for (i = 0; i < count; i++)
+    {
+      queue.runs[i].options = &options;
+      queue.runs[i].trace = argv[arg + i];
+    }
+
+    threads = (pthread_t *) malloc(workers * sizeof(pthread_t));
+    for (i = 0; i < workers; i++)
+      if (pthread_create(&threads[i], NULL, worker, &queue))
+        break;
+    if (!i)
+    {
+      fprintf(stderr, "%s: cannot start a worker thread\n", argv[0]);
+      return 1;
+    }
+    workers = i;
+    for (i = 0; i < workers; i++)
+      pthread_join(threads[i], NULL);
+
+    for (i = 0; i < count; i++)
+    {
+      snprintf(prefix, sizeof(prefix), "%s: ", queue.runs[i].trace);
+      if (queue.runs[i].status == 0)
+        report(&queue.runs[i], prefix);
+      else
+        status = queue.runs[i].status;
+    }
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+    free(queue.runs);
+  }
+#else
+  fprintf(stderr, "%s: running several traces at once needs a build with "
+    "-DTHREAD_LOCAL_HARDWARE\n", argv[0]);
+  status = 1;
+#endif
+  return status;
+}
@@ -0,0 +1,286 @@
+#include <stdlib.h>
+
+#include "hardware.h"
+#include "process_table.h"
+#include "scheduler.h"
+
+/* Proportional share scheduling by tickets.
+
+   Stride scheduling gives every process a pass, which advances by
+   STRIDE_ONE / tickets for every millisecond it runs, and always runs the
+   process with the lowest pass, so over any stretch of time the processes
+   competing get CPU time in proportion to their tickets, give or take a
+   quantum. The run queue is a binary min-heap on pass: enqueueing and
+   dequeueing take O(log n) and picking O(1).
+
+   Lottery scheduling draws a ticket at random from the READY processes
+   and runs the process holding it, so shares are only right on average.
+   The run queue is the same array, but instead of being ordered every
+   node counts the tickets in its subtree; drawing walks down from the
+   root, and enqueueing and dequeueing update the counts of one path, all
+   in O(log n). */
+
+#define STRIDE_ONE (1 << 20)
+
+static int tickets(PID_type pid)
+{
+  return process_sched(pid)->tickets;
+}
+
+// Puts pid at index i of the queue's array
+
+static void place(STRIDE_QUEUE *queue, int i, PID_type pid)
+{
+  queue->heap[i] = pid;
+  process_sched(pid)->heap_index = i;
+}
+
+// Appends pid to the queue's array, growing it if needed, and returns its
+// index
+
+static int append(STRIDE_QUEUE *queue, PID_type pid)
+{
+  if (queue->count == queue->capacity)
+  {
+    queue->capacity = queue->capacity ? queue->capacity * 2 : 64;
+    queue->heap = (PID_type *) realloc(queue->heap,
+      queue->capacity * sizeof(PID_type));
+    queue->tickets = (long long *) realloc(queue->tickets,
+      queue->capacity * sizeof(long long));
+  }
+  place(queue, queue->count, pid);
+  return queue->count++;
+}
+
+static void stride_init(RUN_QUEUE *run_queue)
+{
+  run_queue->stride.heap = NULL;
+  run_queue->stride.tickets = NULL;
+  run_queue->stride.count = 0;
+  run_queue->stride.capacity = 0;
+  run_queue->stride.min_pass = 0;
+  run_queue->stride.seed = 0x9E3779B97F4A7C15ULL;
+}
+
+static void stride_destroy(RUN_QUEUE *run_queue)
+{
+  free(run_queue->stride.heap);
+  free(run_queue->stride.tickets);
+  stride_init(run_queue);
+}
+
+// Heap order: pass, then PID so that ties go the same way every run
+
+static BOOL before(PID_type a, PID_type b)
+{
+  PROCESS_SCHED *sa = process_sched(a), *sb = process_sched(b);
+
+  return sa->vruntime < sb->vruntime ||
+    (sa->vruntime == sb->vruntime && a < b);
+}
+
+static void sift_up(STRIDE_QUEUE *queue, int i)
+{
+  PID_type pid = queue->heap[i];
+
+  for (; i > 0 && before(pid, queue->heap[(i - 1) / 2]); i = (i - 1) / 2)
+    place(queue, i, queue->heap[(i - 1) / 2]);
+  place(queue, i, pid);
+}
+
+static void sift_down(STRIDE_QUEUE *queue, int i)
+{
+  PID_type pid = queue->heap[i];
+  int child;
+
+  while ((child = 2 * i + 1) < queue->count)
+  {
+    if (child + 1 < queue->count &&
+      before(queue->heap[child + 1], queue->heap[child]))
+      child++;
+    if (!before(queue->heap[child], pid))
+      break;
+    place(queue, i, queue->heap[child]);
+    i = child;
+  }
+  place(queue, i, pid);
+}
+
+static void stride_on_wake(RUN_QUEUE *run_queue, PID_type pid)
+{
+  // Time spent away does not count: a process joins no further behind
+  // than the processes that have been competing all along
+
+  if (process_sched(pid)->vruntime < run_queue->stride.min_pass)
+    process_sched(pid)->vruntime = run_queue->stride.min_pass;
+}
+
+static void stride_enqueue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  sift_up(&run_queue->stride, append(&run_queue->stride, pid));
+}
+
+static PID_type stride_pick_next(RUN_QUEUE *run_queue)
+{
+  return run_queue->stride.count ? run_queue->stride.heap[0] : NO_PID;
+}
+
+static void stride_dequeue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  STRIDE_QUEUE *queue = &run_queue->stride;
+  int i = process_sched(pid)->heap_index;
+  PID_type last = queue->heap[--queue->count];
+
+  process_sched(pid)->heap_index = -1;
+  if (process_sched(pid)->vruntime > queue->min_pass)
+    queue->min_pass = process_sched(pid)->vruntime;
+
+  // Fill the hole with the last process and move it to where it belongs
+
+  if (i == queue->count)
+    return;
+  place(queue, i, last);
+  if (i > 0 && before(last, queue->heap[(i - 1) / 2]))
+    sift_up(queue, i);
+  else
+    sift_down(queue, i);
+}
+
+static int stride_time_slice(RUN_QUEUE *run_queue, PID_type pid)
+{
+  return QUANTUM;
+}
+
+static void stride_tick(RUN_QUEUE *run_queue, PID_type pid, int ran,
+  BOOL expired)
+{
+  process_sched(pid)->vruntime += (long long) ran * STRIDE_ONE / tickets(pid);
+}
+
+static void stride_on_block(RUN_QUEUE *run_queue, PID_type pid,
+  BOOL early)
+{
+}
+
+const SCHED_POLICY stride_policy = {
+  "stride",
+  TRUE,
+  stride_init,
+  stride_destroy,
+  stride_on_wake,
+  stride_enqueue,
+  stride_pick_next,
+  stride_dequeue,
+  stride_time_slice,
+  stride_tick,
+  stride_on_block
+};
+
+// Recounts the tickets of the subtrees rooted on the path from i up to the
+// root
+
+static void recount(STRIDE_QUEUE *queue, int i)
+{
+  int child;
+
+  if (i >= queue->count)
+    i = (i - 1) / 2;
+  if (i < 0 || !queue->count)
+    return;
+
+  for (;;)
+  {
+    child = 2 * i + 1;
+    queue->tickets[i] = tickets(queue->heap[i]) +
+      (child < queue->count ? queue->tickets[child] : 0) +
+      (child + 1 < queue->count ? queue->tickets[child + 1] : 0);
+    if (!i)
+      break;
+    i = (i - 1) / 2;
+  }
+}
+
+// Returns a random number below limit (xorshift64*)
+
+static long long draw(STRIDE_QUEUE *queue, long long limit)
+{
+  queue->seed ^= queue->seed >> 12;
+  queue->seed ^= queue->seed << 25;
+  queue->seed ^= queue->seed >> 27;
+  return (long long) ((queue->seed * 0x2545F4914F6CDD1DULL) >> 1) % limit;
+}
+
+static void lottery_on_wake(RUN_QUEUE *run_queue, PID_type pid)
+{
+}
+
+static void lottery_enqueue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  recount(&run_queue->stride, append(&run_queue->stride, pid));
+}
+
+static PID_type lottery_pick_next(RUN_QUEUE *run_queue)
+{
+  STRIDE_QUEUE *queue = &run_queue->stride;
+  long long ticket;
+  int i = 0, child;
+
+  if (!queue->count)
+    return NO_PID;
+
+  // Find the winning ticket: in the left subtree, at the node itself or in
+  // the right subtree
+
+  ticket = draw(queue, queue->tickets[0]);
+  for (;;)
+  {
+    child = 2 * i + 1;
+    if (child < queue->count && ticket < queue->tickets[child])
+    {
+      i = child;
+      continue;
+    }
+    if (child < queue->count)
+      ticket -= queue->tickets[child];
+    if (ticket < tickets(queue->heap[i]))
+      return queue->heap[i];
+    ticket -= tickets(queue->heap[i]);
+    i = child + 1;
+  }
+}
+
+static void lottery_dequeue(RUN_QUEUE *run_queue, PID_type pid)
+{
+  STRIDE_QUEUE *queue = &run_queue->stride;
+  int i = process_sched(pid)->heap_index;
+  int last = --queue->count;
+
+  process_sched(pid)->heap_index = -1;
+
+  // Fill the hole with the last process; both its old and its new place
+  // change the counts above them
+
+  if (i != last)
+    place(queue, i, queue->heap[last]);
+  recount(queue, last);
+  recount(queue, i);
+}
+
+static void lottery_tick(RUN_QUEUE *run_queue, PID_type pid, int ran,
+  BOOL expired)
+{
+}
+
+const SCHED_POLICY lottery_policy = {
+  "lottery",
+  TRUE,
+  stride_init,
+  stride_destroy,
+  lottery_on_wake,
+  lottery_enqueue,
+  lottery_pick_next,
+  lottery_dequeue,
+  stride_time_slice,
+  lottery_tick,
+  stride_on_block
+};
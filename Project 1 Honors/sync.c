@@ -0,0 +1,206 @@
+#include <stdlib.h>
+
+#include "hardware.h"
+#include "process_table.h"
+#include "sync.h"
+
+// Put a process at the end of a queue
+
+static void push(PID_QUEUE *queue, PID_type pid)
+{
+  PROCESS_LINKS *links = process_links(pid);
+
+  links->next = NO_PID;
+  links->prev = queue->tail;
+  if (queue->head == NO_PID)
+    queue->head = pid;
+  else
+    process_links(queue->tail)->next = pid;
+  queue->tail = pid;
+}
+
+// Move the processes from the head of a queue up to last (inclusive) to
+// the end of another, without visiting them
+
+static void splice(PID_QUEUE *to, PID_QUEUE *from, PID_type last)
+{
+  PID_type first = from->head;
+
+  from->head = process_links(last)->next;
+  if (from->head == NO_PID)
+    from->tail = NO_PID;
+  else
+    process_links(from->head)->prev = NO_PID;
+
+  process_links(last)->next = NO_PID;
+  process_links(first)->prev = to->tail;
+  if (to->head == NO_PID)
+    to->head = first;
+  else
+    process_links(to->tail)->next = first;
+  to->tail = last;
+}
+
+void sync_table_init(SYNC_TABLE *table, int rwlocks, int condvars, int mode)
+{
+  int id;
+
+  if (rwlocks > MAX_RWLOCKS)
+    rwlocks = MAX_RWLOCKS;
+  table->rwlocks = (RWLOCK *) malloc(rwlocks * sizeof(RWLOCK));
+  table->rwlock_count = rwlocks;
+  table->condvars = (CONDVAR *) malloc(condvars * sizeof(CONDVAR));
+  table->condvar_count = condvars;
+  table->mode = mode;
+
+  for (id = 0; id < rwlocks; id++)
+  {
+    table->rwlocks[id].waiting.head = NO_PID;
+    table->rwlocks[id].waiting.tail = NO_PID;
+    table->rwlocks[id].waiting_writers.head = NO_PID;
+    table->rwlocks[id].waiting_writers.tail = NO_PID;
+    table->rwlocks[id].waiting_readers = 0;
+    table->rwlocks[id].readers = 0;
+    table->rwlocks[id].writer = NO_PID;
+  }
+  for (id = 0; id < condvars; id++)
+  {
+    table->condvars[id].waiting.head = NO_PID;
+    table->condvars[id].waiting.tail = NO_PID;
+  }
+}
+
+void sync_table_free(SYNC_TABLE *table)
+{
+  free(table->rwlocks);
+  free(table->condvars);
+  table->rwlocks = NULL;
+  table->rwlock_count = 0;
+  table->condvars = NULL;
+  table->condvar_count = 0;
+}
+
+RWLOCK *rwlock_get(SYNC_TABLE *table, int id)
+{
+  if ((unsigned int) id >= (unsigned int) table->rwlock_count)
+    return NULL;
+  return &table->rwlocks[id];
+}
+
+CONDVAR *condvar_get(SYNC_TABLE *table, int id)
+{
+  if ((unsigned int) id >= (unsigned int) table->condvar_count)
+    return NULL;
+  return &table->condvars[id];
+}
+
+BOOL rwlock_acquire(SYNC_TABLE *table, int id, PID_type pid, BOOL write)
+{
+  RWLOCK *lock = &table->rwlocks[id];
+  BOOL queued;
+
+  // Nobody gets ahead of the processes already waiting that they would
+  // have to wait behind: in a fair lock everyone, in a writer-preferred
+  // one the writers
+
+  process_cold(pid)->rwlocks_held |= 1u << id;
+  queued = lock->waiting_writers.head != NO_PID ||
+    (table->mode == RWLOCK_FAIR && lock->waiting.head != NO_PID);
+  if (lock->writer == NO_PID && !queued && (!write || !lock->readers))
+  {
+    if (write)
+      lock->writer = pid;
+    else
+      lock->readers++;
+    return TRUE;
+  }
+
+  process_cold(pid)->sync_write = write;
+  if (write && table->mode == RWLOCK_WRITER_PREFERRED)
+    push(&lock->waiting_writers, pid);
+  else
+  {
+    push(&lock->waiting, pid);
+    if (!write)
+      lock->waiting_readers++;
+  }
+  return FALSE;
+}
+
+void rwlock_release(SYNC_TABLE *table, int id, PID_type pid,
+  PID_QUEUE *granted)
+{
+  RWLOCK *lock = &table->rwlocks[id];
+  PID_type last, next;
+
+  process_cold(pid)->rwlocks_held &= ~(1u << id);
+  if (lock->writer == pid)
+    lock->writer = NO_PID;
+  else
+    lock->readers--;
+  if (lock->readers)
+    return;
+
+  // The lock is free: a waiting writer gets it alone, or the waiting
+  // readers, all in one splice, get it together
+
+  if (lock->waiting_writers.head != NO_PID)
+  {
+    lock->writer = lock->waiting_writers.head;
+    splice(granted, &lock->waiting_writers, lock->writer);
+    return;
+  }
+  if (lock->waiting.head == NO_PID)
+    return;
+
+  if (table->mode == RWLOCK_WRITER_PREFERRED)
+  {
+    lock->readers = lock->waiting_readers;
+    lock->waiting_readers = 0;
+    splice(granted, &lock->waiting, lock->waiting.tail);
+    return;
+  }
+
+  // A fair lock goes to the first waiter, and the readers right behind a
+  // first reader
+
+  last = lock->waiting.head;
+  if (process_cold(last)->sync_write)
+    lock->writer = last;
+  else
+  {
+    lock->readers = 1;
+    while ((next = process_links(last)->next) != NO_PID &&
+      !process_cold(next)->sync_write)
+    {
+      last = next;
+      lock->readers++;
+    }
+    lock->waiting_readers -= lock->readers;
+  }
+  splice(granted, &lock->waiting, last);
+}
+
+void condvar_wait(SYNC_TABLE *table, int id, PID_type pid)
+{
+  push(&table->condvars[id].waiting, pid);
+}
+
+PID_type condvar_signal(SYNC_TABLE *table, int id)
+{
+  CONDVAR *cond = &table->condvars[id];
+  PID_QUEUE woken = { NO_PID, NO_PID };
+  PID_type pid = cond->waiting.head;
+
+  if (pid != NO_PID)
+    splice(&woken, &cond->waiting, pid);
+  return pid;
+}
+
+void condvar_broadcast(SYNC_TABLE *table, int id, PID_QUEUE *woken)
+{
+  CONDVAR *cond = &table->condvars[id];
+
+  if (cond->waiting.head != NO_PID)
+    splice(woken, &cond->waiting, cond->waiting.tail);
+}
@@ -0,0 +1,123 @@
+
+/* Reader-writer locks and condition variables (see RWLOCK_OP and
+   CONDVAR_OP in kernel.h), next to the semaphores of semaphore.h.
+
+   A reader-writer lock is held by any number of readers or by one writer.
+   How it orders the processes waiting for it is its mode, the same for
+   every lock of a table (see kernel_set_rwlock_mode() in kernel.h):
+
+   RWLOCK_WRITER_PREFERRED : a reader waits while a writer holds the lock
+                             or waits for it, so readers cannot starve
+                             writers. When the lock is released the next
+                             writer gets it, or, with no writer waiting,
+                             every waiting reader at once.
+   RWLOCK_FAIR             : everyone waits in one queue in the order they
+                             came, so nobody starves. When the lock is
+                             released the first waiter gets it, and if
+                             that is a reader so do the readers right
+                             behind it.
+
+   Every process keeps the locks it holds, for reading or writing, as a
+   bitmask, so a table has at most MAX_RWLOCKS locks. A lock counts as
+   held from the moment it is asked for, since a process waiting for it
+   cannot do anything with it until it is handed over.
+
+   A condition variable is a queue of processes waiting to be signalled.
+   A process waits on one while holding a reader-writer lock, which it
+   gives up while it waits and gets back, the same way, before it runs
+   again.
+
+   Every wait queue is an intrusive PID_QUEUE inside the lock or condition
+   variable, so nothing ever allocates. Handing a lock to every waiting
+   reader, and waking every process waiting on a condition variable, move
+   the whole queue at once, whatever its length. The kernel then makes
+   each process it got READY. */
+
+#define RWLOCK_WRITER_PREFERRED 0
+#define RWLOCK_FAIR 1
+
+// Marks "no lock" (see sync_lock in PROCESS_COLD)
+
+#define NO_RWLOCK -1
+
+// The most locks a table can have (the bits of rwlocks_held)
+
+#define MAX_RWLOCKS 32
+
+// Operations of the RWLOCK_OP trap, in R3
+
+#define RWLOCK_READ 0
+#define RWLOCK_WRITE 1
+#define RWLOCK_UNLOCK 2
+
+// Operations of the CONDVAR_OP trap, in R3
+
+#define CONDVAR_WAIT 0       /* the lock held in R4 */
+#define CONDVAR_SIGNAL 1
+#define CONDVAR_BROADCAST 2
+
+typedef struct {
+  // The waiting processes: everyone in a fair lock, the readers in a
+  // writer-preferred one, whose writers wait in waiting_writers
+
+  PID_QUEUE waiting;
+  PID_QUEUE waiting_writers;
+  int waiting_readers;
+
+  // How many readers hold the lock, or the writer holding it (NO_PID if
+  // none)
+
+  int readers;
+  PID_type writer;
+} RWLOCK;
+
+typedef struct {
+  PID_QUEUE waiting;
+} CONDVAR;
+
+typedef struct {
+  RWLOCK *rwlocks;
+  int rwlock_count;
+  CONDVAR *condvars;
+  int condvar_count;
+  int mode;
+} SYNC_TABLE;
+
+// Sets up a table of free locks and empty condition variables
+
+void sync_table_init(SYNC_TABLE *table, int rwlocks, int condvars, int mode);
+
+// Frees a table's locks and condition variables
+
+void sync_table_free(SYNC_TABLE *table);
+
+// Return a lock or condition variable, or NULL if the ID is out of range
+
+RWLOCK *rwlock_get(SYNC_TABLE *table, int id);
+CONDVAR *condvar_get(SYNC_TABLE *table, int id);
+
+// Gives a process a lock it does not hold, for writing or reading, and
+// returns TRUE if it can have it now; otherwise puts it on the lock's
+// queue and returns FALSE
+
+BOOL rwlock_acquire(SYNC_TABLE *table, int id, PID_type pid, BOOL write);
+
+// Returns TRUE if a process holds a lock
+
+static inline BOOL rwlock_held(PID_type pid, int id)
+{
+  return (process_cold(pid)->rwlocks_held >> id) & 1;
+}
+
+// Releases a process's hold on a lock (it must hold it), handing the lock
+// to the processes next in line, which are put on granted
+
+void rwlock_release(SYNC_TABLE *table, int id, PID_type pid,
+  PID_QUEUE *granted);
+
+// Put a process on a condition variable's queue; take the first process
+// off it (NO_PID if empty), or move every one of them to woken
+
+void condvar_wait(SYNC_TABLE *table, int id, PID_type pid);
+PID_type condvar_signal(SYNC_TABLE *table, int id);
+void condvar_broadcast(SYNC_TABLE *table, int id, PID_QUEUE *woken);
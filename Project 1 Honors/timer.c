@@ -0,0 +1,189 @@
+#include <stdio.h>
+
+#include "hardware.h"
+#include "kernel.h"
+#include "process_table.h"
+#include "timer.h"
+
+// The tick a time falls in, and the first tick at or after it
+
+#define TICK(time) ((time) / CLOCK_INTERRUPT_PERIOD)
+#define TICK_AFTER(time) \
+  (TICK(time) + ((time) % CLOCK_INTERRUPT_PERIOD != 0))
+
+// Number of low bits of a tick below a level's slot index
+
+#define SHIFT(level) (TIMER_SLOT_BITS * (level))
+
+// Puts a process in the slot its timer belongs in at the wheel's current
+// tick: level 0 if it expires within TIMER_SLOTS ticks, otherwise the
+// lowest level whose slots reach it
+
+static void place(TIMER_WHEEL *wheel, PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+  unsigned int delta = cold->timer_expires - wheel->now;
+  int level = 0, slot;
+
+  while (level < TIMER_LEVELS - 1 && delta >> SHIFT(level + 1))
+    level++;
+  slot = cold->timer_expires >> SHIFT(level) & TIMER_SLOT_MASK;
+
+  cold->timer_slot = level * TIMER_SLOTS + slot;
+  cold->timer_prev = NO_PID;
+  cold->timer_next = wheel->slots[level][slot];
+  if (cold->timer_next != NO_PID)
+    process_cold(cold->timer_next)->timer_prev = pid;
+  wheel->slots[level][slot] = pid;
+  wheel->occupied[level] |= 1ULL << slot;
+}
+
+static void unplace(TIMER_WHEEL *wheel, PID_type pid)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+  int level = cold->timer_slot / TIMER_SLOTS;
+  int slot = cold->timer_slot % TIMER_SLOTS;
+
+  if (cold->timer_prev == NO_PID)
+    wheel->slots[level][slot] = cold->timer_next;
+  else
+    process_cold(cold->timer_prev)->timer_next = cold->timer_next;
+  if (cold->timer_next != NO_PID)
+    process_cold(cold->timer_next)->timer_prev = cold->timer_prev;
+  if (wheel->slots[level][slot] == NO_PID)
+    wheel->occupied[level] &= ~(1ULL << slot);
+  cold->timer_slot = NO_TIMER;
+}
+
+// Moves every timer of a slot above level 0, whose ticks have come round,
+// down to where it now belongs
+
+static void cascade(TIMER_WHEEL *wheel, int level, int slot)
+{
+  PID_type pid = wheel->slots[level][slot], next;
+
+  wheel->slots[level][slot] = NO_PID;
+  wheel->occupied[level] &= ~(1ULL << slot);
+  for (; pid != NO_PID; pid = next)
+  {
+    next = process_cold(pid)->timer_next;
+    place(wheel, pid);
+  }
+}
+
+// The next tick after the wheel's current one at which an occupied slot
+// comes round: at level 0 its timers expire, above it they cascade. A
+// slot at or before the level's current one comes round on the next
+// turn of the level.
+
+static unsigned int next_tick(TIMER_WHEEL *wheel)
+{
+  unsigned int best = 0, tick, base;
+  unsigned long long later;
+  int level, current, slot;
+
+  for (level = 0; level < TIMER_LEVELS; level++)
+  {
+    if (!wheel->occupied[level])
+      continue;
+    current = wheel->now >> SHIFT(level) & TIMER_SLOT_MASK;
+    base = (wheel->now >> SHIFT(level)) - current;
+    later = current == TIMER_SLOT_MASK ? 0 :
+      wheel->occupied[level] >> (current + 1) << (current + 1);
+    if (later)
+      slot = __builtin_ctzll(later);
+    else
+      slot = __builtin_ctzll(wheel->occupied[level]) + TIMER_SLOTS;
+    tick = (base + slot) << SHIFT(level);
+    if (!best || tick < best)
+      best = tick;
+  }
+  return best;
+}
+
+void timer_init(TIMER_WHEEL *wheel, CLOCK_TIME time)
+{
+  int level, slot;
+
+  for (level = 0; level < TIMER_LEVELS; level++)
+  {
+    for (slot = 0; slot < TIMER_SLOTS; slot++)
+      wheel->slots[level][slot] = NO_PID;
+    wheel->occupied[level] = 0;
+  }
+  wheel->now = TICK(time);
+  wheel->count = 0;
+}
+
+void timer_add(TIMER_WHEEL *wheel, PID_type pid, CLOCK_TIME expires)
+{
+  PROCESS_COLD *cold = process_cold(pid);
+
+  // The current tick has been dealt with, so the earliest a timer can
+  // expire is the next one
+
+  cold->timer_expires = TICK_AFTER(expires < LAST_TICK_TIME ? expires :
+    LAST_TICK_TIME);
+  if (cold->timer_expires <= wheel->now)
+    cold->timer_expires = wheel->now + 1;
+  place(wheel, pid);
+  wheel->count++;
+}
+
+void timer_cancel(TIMER_WHEEL *wheel, PID_type pid)
+{
+  if (process_cold(pid)->timer_slot == NO_TIMER)
+    return;
+  unplace(wheel, pid);
+  wheel->count--;
+}
+
+PID_type timer_expire(TIMER_WHEEL *wheel, CLOCK_TIME time)
+{
+  unsigned int tick = TICK(time), next;
+  int level, slot;
+  PID_type pid;
+
+  while (wheel->count)
+  {
+    // Only timers expiring at the current tick are ever in its level 0
+    // slot
+
+    slot = wheel->now & TIMER_SLOT_MASK;
+    if (wheel->slots[0][slot] != NO_PID)
+    {
+      pid = wheel->slots[0][slot];
+      timer_cancel(wheel, pid);
+      return pid;
+    }
+
+    // Go straight to the next tick with something to do, if it has come,
+    // and cascade the slots that come round then, the highest first
+
+    next = next_tick(wheel);
+    if (next > tick)
+      break;
+    wheel->now = next;
+    for (level = TIMER_LEVELS - 1; level > 0; level--)
+      if (!(next & ((1U << SHIFT(level)) - 1)))
+        cascade(wheel, level, next >> SHIFT(level) & TIMER_SLOT_MASK);
+  }
+
+  // Nothing is due in between, so the skipped ticks need no work
+
+  if (tick > wheel->now)
+    wheel->now = tick;
+  return NO_PID;
+}
+
+CLOCK_TIME timer_next(TIMER_WHEEL *wheel)
+{
+  unsigned int tick;
+
+  // Only a timer set once the wheel has reached LAST_TICK_TIME can be due
+  // after it
+
+  if (!wheel->count || (tick = next_tick(wheel)) > TICK(LAST_TICK_TIME))
+    return NO_DEADLINE;
+  return tick * CLOCK_INTERRUPT_PERIOD;
+}
@@ -0,0 +1,72 @@
+/* Timers for the SLEEP trap and timed semaphore DOWNs (see kernel.h), on
+   a hierarchical timer wheel.
+
+   A timer expires at the first clock tick (every CLOCK_INTERRUPT_PERIOD
+   ms) at or after its expiry time, and the wheel counts time in ticks.
+   Level 0 has a slot for each of the next TIMER_SLOTS ticks; every level
+   above has a slot for each of the next TIMER_SLOTS slots' worth of the
+   level below, so TIMER_LEVELS levels cover TIMER_SLOTS^TIMER_LEVELS
+   ticks, more than there are before a CLOCK_TIME wraps (expiry times are
+   clamped to LAST_TICK_TIME, see kernel.h). A timer goes in the slot of the
+   lowest level that reaches its expiry. When the ticks of a slot above
+   level 0 come round, its timers are cascaded, each into the slot of a
+   lower level that now reaches it, so every timer moves at most
+   TIMER_LEVELS - 1 times before it reaches level 0 and expires.
+
+   A process has at most one timer (it is asleep or waiting on one
+   semaphore), so each slot is a list threaded through the timer fields of
+   PROCESS_COLD, doubly linked so that a timer can be cancelled where it
+   is. Adding, cancelling and expiring a timer all take constant time and
+   never allocate. Each level also keeps a bitmap of its occupied slots, so
+   the next tick at which anything happens is found without looking at
+   the empty ones, however long the wheel has been left alone: the kernel
+   only needs a clock interrupt then (see kernel_next_deadline()), and
+   ticks skipped in between are caught up on all at once. */
+
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+#define TIMER_LEVELS 5
+
+// The timer_slot of a process without a timer
+
+#define NO_TIMER -1
+
+typedef struct {
+  // Every slot's first process (NO_PID if empty), and which are occupied
+
+  PID_type slots[TIMER_LEVELS][TIMER_SLOTS];
+  unsigned long long occupied[TIMER_LEVELS];
+
+  // The last tick the wheel has caught up with, and how many timers are
+  // set
+
+  unsigned int now;
+  int count;
+} TIMER_WHEEL;
+
+// Sets up an empty wheel at the given time
+
+void timer_init(TIMER_WHEEL *wheel, CLOCK_TIME time);
+
+// Sets a process's timer (it must not have one) to expire at the given
+// time, or at LAST_TICK_TIME if that is sooner; a time already past
+// expires at the next tick
+
+void timer_add(TIMER_WHEEL *wheel, PID_type pid, CLOCK_TIME expires);
+
+// Cancels a process's timer, if it has one
+
+void timer_cancel(TIMER_WHEEL *wheel, PID_type pid);
+
+// Catches the wheel up with the given time and returns a process whose
+// timer has expired (which no longer has one), or NO_PID once there are
+// none; called until it returns NO_PID
+
+PID_type timer_expire(TIMER_WHEEL *wheel, CLOCK_TIME time);
+
+// Returns the time of the next tick at which the wheel has something to
+// do, or NO_DEADLINE (see kernel.h) if no timer is set or that tick comes
+// after LAST_TICK_TIME
+
+CLOCK_TIME timer_next(TIMER_WHEEL *wheel);
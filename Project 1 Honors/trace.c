@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware.h"
+#include "trace.h"
+
+const char *trace_op_names[NUMBER_OF_TRACE_OPS] = { "run", "diskread",
+  "keyboardread", "diskwrite", "down", "up", "fork", "semcreate",
+  "semdestroy", "adiskread", "diskwait", "nice", "sleep",
+  "groupcreate", "groupjoin", "realtime", "rlock", "wlock", "unlock",
+  "condwait", "signal", "broadcast" };
+
+int trace_parse_line(const char *line, PID_type *pid, TRACE_EVENT *event)
+{
+  char name[32];
+  int fields, op;
+
+  event->arg = 0;
+  event->arg2 = 0;
+  event->arg3 = 0;
+  fields = sscanf(line, "%d %31s %d %d %d", pid, name, &event->arg,
+    &event->arg2, &event->arg3);
+  if (fields <= 0)
+    return 0;
+
+  for (op = 0; op < NUMBER_OF_TRACE_OPS; op++)
+    if (!strcmp(name, trace_op_names[op]))
+      break;
+  if (fields < 2 || *pid < 0 || op == NUMBER_OF_TRACE_OPS)
+    return -1;
+  event->op = op;
+
+  // A disk read without a block is one whose block is unknown
+
+  if ((op == DISK_READ_EVENT || op == DISK_READ_ASYNC_EVENT) && fields < 4)
+    event->arg2 = -1;
+  return 1;
+}
@@ -0,0 +1,80 @@
+/* Process traces for the simulator (see simulator.c), in text or binary.
+
+   A text trace, such as processes.dat, has one event per line:
+   "<pid> <op> [<arg> [<arg2> [<arg3>]]]", op being one of trace_op_names.
+
+   A binary trace holds the same events grouped by process, in fixed-size
+   records, so that the simulator can map the file into memory and run
+   every process's events where they lie, with nothing to parse or copy:
+
+   TRACE_HEADER                   TRACE_MAGIC and the number of processes
+                                  and of events
+   TRACE_INDEX[program_count]     for every PID below program_count, where
+                                  its events start and how many there are
+   TRACE_EVENT[event_count]       the events of every process, each
+                                  process's in trace order
+
+   all in the byte order of the machine that wrote it. trace_convert turns
+   a text trace into a binary one. */
+
+#define TRACE_MAGIC "KTRACE2"
+
+typedef enum { RUN, DISK_READ_EVENT, KEYBOARD_READ_EVENT, DISK_WRITE_EVENT,
+  DOWN, UP, FORK, SEMAPHORE_CREATE_EVENT, SEMAPHORE_DESTROY_EVENT,
+  DISK_READ_ASYNC_EVENT, DISK_WAIT_EVENT, NICE, SLEEP_EVENT,
+  GROUP_CREATE_EVENT, GROUP_JOIN_EVENT, REALTIME_EVENT, RLOCK_EVENT,
+  WLOCK_EVENT, UNLOCK_EVENT, CONDWAIT_EVENT, SIGNAL_EVENT, BROADCAST_EVENT,
+  NUMBER_OF_TRACE_OPS
+} TRACE_OP;
+
+typedef struct {
+  char magic[8];
+  int program_count;
+  int reserved;
+  long long event_count;
+} TRACE_HEADER;
+
+typedef struct {
+  long long first;  /* index of the process's first event */
+  int count;
+  int reserved;
+} TRACE_INDEX;
+
+typedef struct {
+  int op;  /* a TRACE_OP */
+  int arg;
+  int arg2;
+  int arg3;
+} TRACE_EVENT;
+
+/* The ops' names in a text trace, indexed by TRACE_OP */
+
+extern const char *trace_op_names[NUMBER_OF_TRACE_OPS];
+
+/* Parses a line of a text trace into pid and event (arguments not given
+   are 0, except a disk read's block, which is -1, NO_BLOCK in disk.h).
+   Returns 1 if it holds an event, 0 if it is blank and -1 if it is not a
+   trace line. */
+
+int trace_parse_line(const char *line, PID_type *pid, TRACE_EVENT *event);
+
+// Return the index and the events of a binary trace whose header is at
+// header
+
+static inline const TRACE_INDEX *trace_index(const TRACE_HEADER *header)
+{
+  return (const TRACE_INDEX *) (header + 1);
+}
+
+static inline const TRACE_EVENT *trace_events(const TRACE_HEADER *header)
+{
+  return (const TRACE_EVENT *) (trace_index(header) + header->program_count);
+}
+
+/* Size of a binary trace with that many processes and events */
+
+static inline long long trace_size(int program_count, long long event_count)
+{
+  return sizeof(TRACE_HEADER) + program_count * (long long)
+    sizeof(TRACE_INDEX) + event_count * (long long) sizeof(TRACE_EVENT);
+}
@@ -0,0 +1,133 @@
+/* Converts a text trace, such as processes.dat, into a binary trace that
+   the simulator maps instead of parsing (see trace.h).
+
+   Usage: trace_convert <text trace> <binary trace>
+
+   The text trace is read twice: once to count every process's events and
+   lay out the index, and once to put each event straight into its place
+   in the binary trace, which is mapped, so the events are never held in
+   memory as a whole. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hardware.h"
+#include "trace.h"
+
+// Reads the next event of the text trace; returns 0 at its end
+
+static int next_event(const char *path, FILE *in, int *line_number,
+  PID_type *pid, TRACE_EVENT *event)
+{
+  char line[256];
+  int result;
+
+  while (fgets(line, sizeof(line), in) != NULL)
+  {
+    ++*line_number;
+    if ((result = trace_parse_line(line, pid, event)) > 0)
+      return 1;
+    if (result < 0)
+    {
+      fprintf(stderr, "%s:%d: bad trace line\n", path, *line_number);
+      exit(1);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in;
+  int out, line_number = 0, program_count = 0, capacity = 0;
+  int *counts = NULL;
+  long long event_count = 0, first, size;
+  PID_type pid;
+  TRACE_EVENT event;
+  TRACE_HEADER *header;
+  TRACE_INDEX *index;
+  TRACE_EVENT *events;
+  void *map;
+
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s <text trace> <binary trace>\n", argv[0]);
+    return 1;
+  }
+  if ((in = fopen(argv[1], "r")) == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  // Count the events of every process
+
+  while (next_event(argv[1], in, &line_number, &pid, &event))
+  {
+    if (pid >= capacity)
+    {
+      while (capacity <= pid)
+        capacity = capacity ? capacity * 2 : 16;
+      counts = (int *) realloc(counts, capacity * sizeof(int));
+      memset(counts + program_count, 0,
+        (capacity - program_count) * sizeof(int));
+    }
+    if (pid >= program_count)
+      program_count = pid + 1;
+    counts[pid]++;
+    event_count++;
+  }
+
+  // Lay the binary trace out and map it
+
+  size = trace_size(program_count, event_count);
+  if ((out = open(argv[2], O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 ||
+    ftruncate(out, size) ||
+    (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0)) ==
+    MAP_FAILED)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+
+  header = (TRACE_HEADER *) map;
+  memcpy(header->magic, TRACE_MAGIC, sizeof(header->magic));
+  header->program_count = program_count;
+  header->reserved = 0;
+  header->event_count = event_count;
+
+  // Every process's events start where the previous one's end; count then
+  // tracks how many have been put in place
+
+  index = (TRACE_INDEX *) trace_index(header);
+  events = (TRACE_EVENT *) trace_events(header);
+  for (first = 0, pid = 0; pid < program_count; pid++)
+  {
+    index[pid].first = first;
+    index[pid].count = 0;
+    index[pid].reserved = 0;
+    first += counts[pid];
+  }
+
+  rewind(in);
+  line_number = 0;
+  while (next_event(argv[1], in, &line_number, &pid, &event))
+  {
+    events[index[pid].first + index[pid].count] = event;
+    index[pid].count++;
+  }
+  fclose(in);
+
+  if (munmap(map, size) || close(out))
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  fprintf(stderr, "%lld events of %d processes\n", event_count,
+    program_count);
+  return 0;
+}
@@ -46,14 +46,15 @@ void handle_keyboard_interrupt();
 // Next two methods can be used for both semaphore and process queues
 // Moving declarations here makes it easier
 
-typedef struct PID_queue_elt {
-  struct PID_queue_elt *next;
-  PID_type pid;
-} PID_QUEUE_ELT;
+// Queues are intrusive: a process is on at most one queue (ready or
+// semaphore) at a time, so the link to the next process lives in its
+// process table entry and queueing never allocates. NO_PID marks the end.
+
+#define NO_PID -1
 
 typedef struct {
-  PID_QUEUE_ELT *head;
-  PID_QUEUE_ELT *tail;
+  PID_type head;
+  PID_type tail;
 } PID_QUEUE;
 
 // Schedules a process to run now
@@ -62,7 +63,11 @@ void schedule();
 
 // Put a process at the end of the queue
 
-void enqueue(PID_QUEUE **pointer_to_queue, PID_type pid);
+void enqueue(PID_QUEUE *queue, PID_type pid);
+
+// Take the process at the head of a (non-empty) queue
+
+PID_type dequeue(PID_QUEUE *queue);
 
 typedef enum { RUNNING, READY, BLOCKED , UNINITIALIZED } PROCESS_STATE;
 
@@ -70,26 +75,23 @@ typedef enum { RUNNING, READY, BLOCKED , UNINITIALIZED } PROCESS_STATE;
 typedef struct process_table_entry {
   PROCESS_STATE state;
   int total_CPU_time_used;
+  PID_type next;
 } PROCESS_TABLE_ENTRY;
 
 // Designated initializer for array semaphores (just in case) so random
 // values aren't put there
 
 PROCESS_TABLE_ENTRY process_table[MAX_NUMBER_OF_PROCESSES] =
-  {[0 ... MAX_NUMBER_OF_PROCESSES-1] = { UNINITIALIZED, 0}};
+  {[0 ... MAX_NUMBER_OF_PROCESSES-1] = { UNINITIALIZED, 0, NO_PID}};
 
-// Pointer to the current ready queue entry
+// The ready queue
 
-PID_QUEUE_ELT *ready_queue_entry;
-
-// Pointer to the ready queue
-
-PID_QUEUE *ready_queue;
+PID_QUEUE ready_queue = {NO_PID, NO_PID};
 
 // Semaphore struct
 
 typedef struct {
-  PID_QUEUE *ready_queue;
+  PID_QUEUE ready_queue;
   int value;
 } SEMAPHORE;
 
@@ -107,7 +109,7 @@ typedef struct {
 // values aren't put there
 
 SEMAPHORE semaphores[NUMBER_OF_SEMAPHORES] = {[0 ... NUMBER_OF_SEMAPHORES-1]
-    = { NULL, 1}};
+    = { {NO_PID, NO_PID}, 1}};
 
 /* A quantum is 40 ms */
 
@@ -147,15 +149,6 @@ void initialize_kernel()
   process_table[current_pid].state = RUNNING;
   process_table[current_pid].total_CPU_time_used = 0;
 
-  // Malloc the ready queue
-
-  ready_queue = (PID_QUEUE *) malloc(sizeof(PID_QUEUE));
-
-  // Init the ready queue elemenets
-
-  ready_queue->head = NULL;
-  ready_queue->tail = NULL;
-
   // Initialize current quantum time and counters
 
   current_quantum_start_time = clock;
@@ -248,8 +241,7 @@ void handle_fork()
   process_table[R2].total_CPU_time_used = 0;
   active_processes++;
 
-  // Put new process to the ready queue.
-  // Malloc the new node (hence passing address)
+  // Put new process to the ready queue
 
   enqueue(&ready_queue, R2);
 
@@ -285,18 +277,15 @@ void handle_semaphore()
     printf("Time %d: Process %d issues UP operation on semaphore %d\n", clock,
       current_pid, R2);
 
-    // Check if the semaphore value is 0; check for NULL pointers (nothing in
-    // the queue or it wasn't initialized, which is done by enqueu())
+    // Check if the semaphore value is 0 and someone is waiting on it
 
-    if (!sem->value && (sem->ready_queue != NULL) &&
-      (sem->ready_queue->head != NULL))
+    if (!sem->value && (sem->ready_queue.head != NO_PID))
     {
-      // Get new pid; update the table; put it in the ready queue; rm 1st node
+      // Get new pid; update the table; put it in the ready queue
 
-      PID_type pid = sem->ready_queue->head->pid;
+      PID_type pid = dequeue(&sem->ready_queue);
       process_table[pid].state = READY;
       enqueue(&ready_queue, pid);
-      sem->ready_queue->head = sem->ready_queue->head->next;
     }
     else
     {
@@ -316,7 +305,7 @@ void handle_semaphore()
     }
     else
     {
-      // Block the process; init or update the semaphore's ready queue
+      // Block the process; update the semaphore's ready queue
 
       process_table[current_pid].state = BLOCKED;
       enqueue(&sem->ready_queue, current_pid);
@@ -406,7 +395,7 @@ void schedule()
 
   // Handle case when the queue is empty
 
-  if (ready_queue->head == NULL)
+  if (ready_queue.head == NO_PID)
   {
 
     // If no IO pending - deadlocked system
@@ -424,50 +413,33 @@ void schedule()
   }
   else
   {
-    // Clear the queue of heading blocked processes (i.e. IO'd). Recursive
+    // A process is on one queue at a time, so everything on the ready
+    // queue is READY. Update the table and the queue; run a process
 
-    if (process_table[ready_queue->head->pid].state == BLOCKED)
-    {
-      ready_queue->head = ready_queue->head->next;
-      schedule();
-    }
-    else
-    {
-      // Update the table and the queue; run a process
-      current_pid = ready_queue->head->pid;
-      process_table[current_pid].state = RUNNING;
-      ready_queue->head = ready_queue->head->next;
-      printf("Time %d: Process %d runs\n", clock, current_pid);
-    }
+    current_pid = dequeue(&ready_queue);
+    process_table[current_pid].state = RUNNING;
+    printf("Time %d: Process %d runs\n", clock, current_pid);
   }
 }
 
-void enqueue(PID_QUEUE **pointer_to_queue, PID_type pid)
+void enqueue(PID_QUEUE *queue, PID_type pid)
 {
-  // If a queue is null, then we initialize it
-
-  if (*pointer_to_queue == NULL)
-  {
-    *pointer_to_queue = (PID_QUEUE *) malloc(sizeof(PID_QUEUE));
-    (**pointer_to_queue).head = NULL;
-    (**pointer_to_queue).tail = NULL;
-  }
+  process_table[pid].next = NO_PID;
 
-  // Dereference once for simplicity
-
-  PID_QUEUE *queue = *pointer_to_queue;
-
-  // Init a node
+  // Link to tail (and head if it's empty)
+  if (queue->head == NO_PID)
+    queue->head = pid;
+  else
+    process_table[queue->tail].next = pid;
+  queue->tail = pid;
+}
 
-  PID_QUEUE_ELT *new_ready_queue_element = (PID_QUEUE_ELT *)
-    malloc(sizeof(PID_QUEUE_ELT));
-  new_ready_queue_element->next = NULL;
-  new_ready_queue_element->pid = pid;
+PID_type dequeue(PID_QUEUE *queue)
+{
+  PID_type pid = queue->head;
 
-  // Add a node to tail (and head if it's empty, i.e. just got initialized)
-  if (queue->head == NULL)
-    queue->head = new_ready_queue_element;
-  if (queue->tail != NULL)
-    queue->tail->next = new_ready_queue_element;
-  queue->tail = new_ready_queue_element;
+  queue->head = process_table[pid].next;
+  if (queue->head == NO_PID)
+    queue->tail = NO_PID;
+  return pid;
 }